@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <pthread.h>
+
+#include "budget.h"
+
+static const char *subsystem_names[MEM_SUBSYSTEMS] = { "reply buffers", "queued links", "pending writes" };
+
+static pthread_mutex_t budget_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t budget_freed = PTHREAD_COND_INITIALIZER;
+static size_t limit = DEFAULT_MEMORY_BUDGET;   // 0 means unlimited
+static size_t used_total = 0;
+static size_t used[MEM_SUBSYSTEMS];
+static size_t peak[MEM_SUBSYSTEMS];
+static size_t peak_total = 0;
+static long stalls = 0;
+
+void budget_init(size_t new_limit) {
+    pthread_mutex_lock(&budget_mutex);
+    limit = new_limit;
+    pthread_mutex_unlock(&budget_mutex);
+}
+
+size_t budget_limit(void) {
+    return limit;
+}
+
+// Must be called with budget_mutex held
+static void charge_locked(mem_subsystem_t sub, size_t bytes) {
+    used[sub] += bytes;
+    used_total += bytes;
+    if (used[sub] > peak[sub]) {
+        peak[sub] = used[sub];
+    }
+    if (used_total > peak_total) {
+        peak_total = used_total;
+    }
+}
+
+/*
+ * Reserve bytes for a subsystem.
+ * Without 'wait', returns -1 when the budget cannot cover the request.
+ * With 'wait', blocks until enough is released. A request is always
+ * granted when no reply buffer is in flight or waiting to be written,
+ * so the crawl keeps moving even if queued links alone fill the budget.
+ */
+int budget_reserve(mem_subsystem_t sub, size_t bytes, int wait) {
+    pthread_mutex_lock(&budget_mutex);
+
+    int counted_stall = 0;
+    while (limit > 0 && used_total + bytes > limit &&
+           (used[MEM_REPLY] > 0 || used[MEM_WRITE] > 0)) {
+        if (!wait) {
+            pthread_mutex_unlock(&budget_mutex);
+            return -1;
+        }
+        if (!counted_stall) {
+            stalls++;
+            counted_stall = 1;
+        }
+        pthread_cond_wait(&budget_freed, &budget_mutex);
+    }
+
+    charge_locked(sub, bytes);
+    pthread_mutex_unlock(&budget_mutex);
+    return 0;
+}
+
+// Account for memory that cannot be refused
+void budget_charge(mem_subsystem_t sub, size_t bytes) {
+    pthread_mutex_lock(&budget_mutex);
+    charge_locked(sub, bytes);
+    pthread_mutex_unlock(&budget_mutex);
+}
+
+void budget_release(mem_subsystem_t sub, size_t bytes) {
+    pthread_mutex_lock(&budget_mutex);
+    used[sub] -= bytes;
+    used_total -= bytes;
+    pthread_cond_broadcast(&budget_freed);
+    pthread_mutex_unlock(&budget_mutex);
+}
+
+void budget_print_stats(FILE *out) {
+    pthread_mutex_lock(&budget_mutex);
+    if (limit > 0) {
+        fprintf(out, "Memory budget:\t%zu bytes, %zu in use, peak %zu, %ld stalled fetches\n",
+                limit, used_total, peak_total, stalls);
+    } else {
+        fprintf(out, "Memory budget:\tunlimited, %zu in use, peak %zu\n", used_total, peak_total);
+    }
+    for (int i = 0; i < MEM_SUBSYSTEMS; i++) {
+        fprintf(out, "  %-16s%zu in use, peak %zu\n", subsystem_names[i], used[i], peak[i]);
+    }
+    pthread_mutex_unlock(&budget_mutex);
+}
@@ -0,0 +1,28 @@
+#ifndef BUDGET_H_
+#define BUDGET_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+/*
+ * Global byte budget shared by everything that holds crawl data in memory.
+ * Usage is accounted per subsystem so stats can show where memory goes.
+ */
+
+#define DEFAULT_MEMORY_BUDGET (256UL << 20)
+
+typedef enum mem_subsystem {
+    MEM_REPLY,      // In-flight HTTP reply buffers
+    MEM_QUEUE,      // URLs waiting in the queue
+    MEM_WRITE,      // Data waiting to be written out
+    MEM_SUBSYSTEMS
+} mem_subsystem_t;
+
+void budget_init(size_t limit);
+int budget_reserve(mem_subsystem_t sub, size_t bytes, int wait);
+void budget_charge(mem_subsystem_t sub, size_t bytes);
+void budget_release(mem_subsystem_t sub, size_t bytes);
+size_t budget_limit(void);
+void budget_print_stats(FILE *out);
+
+#endif /* BUDGET_H_ */
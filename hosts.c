@@ -0,0 +1,366 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netdb.h>
+
+#include "hosts.h"
+#include "wgetX.h"
+#include "budget.h"
+
+long host_retry_ms = HOST_RETRY_MS;
+long host_max_retry_ms = HOST_MAX_RETRY_MS;
+int host_give_up_openings = HOST_GIVE_UP_OPENINGS;
+
+static pthread_mutex_t hosts_mutex = PTHREAD_MUTEX_INITIALIZER;
+static host_health_t **host_table = NULL;
+static size_t host_bucket_count = 0;
+static size_t host_count = 0;
+static host_health_t *parked_hosts = NULL;
+static int parked_total = 0;
+
+// Counters for print_stats()
+static long hosts_seen = 0;
+static long circuits_opened = 0;
+static long urls_parked = 0;
+static long hosts_given_up = 0;
+static long urls_dropped = 0;
+
+long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static size_t hash_host(const char *host) {
+    size_t hash = 5381;
+    while (*host) {
+        hash = hash * 33 + (unsigned char)*host++;
+    }
+    return hash;
+}
+
+// Must be called with hosts_mutex held
+static void grow_hosts_locked(void) {
+    size_t new_count = host_bucket_count ? host_bucket_count * 2 : HOST_INITIAL_BUCKETS;
+    host_health_t **buckets = calloc(new_count, sizeof(host_health_t *));
+    if (buckets == NULL) {
+        return;     // Keep the old table, chains just get longer
+    }
+
+    for (size_t i = 0; i < host_bucket_count; i++) {
+        host_health_t *h = host_table[i];
+        while (h) {
+            host_health_t *next = h->next;
+            size_t idx = hash_host(h->host) & (new_count - 1);
+            h->next = buckets[idx];
+            buckets[idx] = h;
+            h = next;
+        }
+    }
+    free(host_table);
+    host_table = buckets;
+    host_bucket_count = new_count;
+}
+
+// Must be called with hosts_mutex held
+static host_health_t *lookup_locked(const char *host, int create) {
+    if (host_bucket_count > 0) {
+        size_t idx = hash_host(host) & (host_bucket_count - 1);
+        for (host_health_t *h = host_table[idx]; h; h = h->next) {
+            if (strcmp(h->host, host) == 0) {
+                return h;
+            }
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+
+    if (host_count >= host_bucket_count) {
+        grow_hosts_locked();
+    }
+    size_t idx = hash_host(host) & (host_bucket_count - 1);
+    host_health_t *h = calloc(1, sizeof(host_health_t));
+    h->host = strdup(host);
+    h->state = CIRCUIT_CLOSED;
+    h->next = host_table[idx];
+    host_table[idx] = h;
+    host_count++;
+    hosts_seen++;
+    return h;
+}
+
+// Parked URLs are charged to the queue budget like queued ones
+static size_t parked_bytes(const queue_item_t *item) {
+    return strlen(item->url) + 1 + (item->parent_url ? strlen(item->parent_url) + 1 : 0);
+}
+
+// Must be called with hosts_mutex held
+static void park_locked(host_health_t *h, queue_item_t *item) {
+    if (h->parked_count == h->parked_cap) {
+        h->parked_cap = h->parked_cap ? h->parked_cap * 2 : 8;
+        h->parked = realloc(h->parked, h->parked_cap * sizeof(queue_item_t));
+    }
+    if (h->parked_count == 0) {
+        h->next_parked = parked_hosts;
+        parked_hosts = h;
+    }
+    h->parked[h->parked_count++] = *item;
+    budget_charge(MEM_QUEUE, parked_bytes(item));
+    parked_total++;
+    urls_parked++;
+}
+
+/*
+ * Decide whether a URL for 'host' may be fetched now. Returns 1 if so;
+ * 0 if the item was parked (the caller gives up ownership); -1 if the
+ * host was given up (the caller keeps the item and drops it). The first
+ * caller after an open or given-up circuit's retry time becomes the
+ * half-open probe.
+ */
+int host_admit_or_park(const char *host, queue_item_t *item) {
+    pthread_mutex_lock(&hosts_mutex);
+    host_health_t *h = lookup_locked(host, 1);
+    int admit = 0;
+
+    switch (h->state) {
+    case CIRCUIT_CLOSED:
+        admit = 1;
+        break;
+    case CIRCUIT_OPEN:
+        if (now_ms() >= h->retry_at) {
+            h->state = CIRCUIT_HALF_OPEN;
+            admit = 1;
+        }
+        break;
+    case CIRCUIT_HALF_OPEN:
+        break;
+    case CIRCUIT_GIVEN_UP:
+        if (now_ms() >= h->retry_at) {
+            h->state = CIRCUIT_HALF_OPEN;
+            admit = 1;
+        } else {
+            admit = -1;
+        }
+        break;
+    }
+
+    if (admit == 0) {
+        park_locked(h, item);
+    }
+    pthread_mutex_unlock(&hosts_mutex);
+    return admit;
+}
+
+// Must be called with hosts_mutex held
+static int drop_parked_locked(host_health_t *h) {
+    int dropped = h->parked_count;
+
+    for (int i = 0; i < h->parked_count; i++) {
+        budget_release(MEM_QUEUE, parked_bytes(&h->parked[i]));
+        free(h->parked[i].url);
+        free(h->parked[i].parent_url);
+    }
+    if (dropped > 0) {
+        host_health_t **link = &parked_hosts;
+        while (*link != h) {
+            link = &(*link)->next_parked;
+        }
+        *link = h->next_parked;
+        h->next_parked = NULL;
+    }
+    h->parked_count = 0;
+    parked_total -= dropped;
+    urls_dropped += dropped;
+    return dropped;
+}
+
+/*
+ * Record the outcome of a fetch; slow responses count as failures.
+ * Returns how many parked URLs were dropped because the host was given up.
+ */
+int host_report(const char *host, int ok) {
+    int dropped = 0;
+
+    pthread_mutex_lock(&hosts_mutex);
+    host_health_t *h = lookup_locked(host, 1);
+
+    if (ok) {
+        if (h->state != CIRCUIT_CLOSED) {
+            fprintf(stderr, "Circuit closed for %s\n", host);
+        }
+        h->state = CIRCUIT_CLOSED;
+        h->failures = 0;
+        h->open_count = 0;
+    } else {
+        h->failures++;
+        if (h->state == CIRCUIT_HALF_OPEN ||
+            (h->state == CIRCUIT_CLOSED && h->failures >= HOST_FAILURE_THRESHOLD)) {
+            long delay = host_retry_ms;
+            for (int i = 0; i < h->open_count && delay < host_max_retry_ms; i++) {
+                delay *= 2;
+            }
+            h->state = CIRCUIT_OPEN;
+            h->open_count++;
+            circuits_opened++;
+            if (host_give_up_openings > 0 && h->open_count >= host_give_up_openings) {
+                // Re-probed at the capped interval from now on
+                if (h->open_count == host_give_up_openings) {
+                    hosts_given_up++;
+                }
+                delay = host_max_retry_ms;
+                h->state = CIRCUIT_GIVEN_UP;
+                dropped = drop_parked_locked(h);
+                fprintf(stderr, "Giving up on %s after %d circuit openings, dropping %d parked URLs, retry in %ld ms\n",
+                        host, h->open_count, dropped, delay);
+            } else {
+                if (delay > host_max_retry_ms) {
+                    delay = host_max_retry_ms;
+                }
+                fprintf(stderr, "Circuit open for %s after %d failures, retry in %ld ms\n",
+                        host, h->failures, delay);
+            }
+            h->retry_at = now_ms() + delay;
+        }
+    }
+    pthread_mutex_unlock(&hosts_mutex);
+    return dropped;
+}
+
+/*
+ * Hand back up to 'max' parked URLs that may be fetched now: all of a
+ * closed host's, and a single probe for an open host whose retry time
+ * has passed. Never takes the queue lock, so it can run under it.
+ */
+int host_take_parked(queue_item_t *items, int max) {
+    int taken = 0;
+
+    pthread_mutex_lock(&hosts_mutex);
+    if (parked_total == 0) {
+        pthread_mutex_unlock(&hosts_mutex);
+        return 0;
+    }
+
+    long now = now_ms();
+    host_health_t **link = &parked_hosts;
+    while (*link && taken < max) {
+        host_health_t *h = *link;
+        int release = 0;
+        if (h->state == CIRCUIT_CLOSED) {
+            release = h->parked_count;
+        } else if (h->state == CIRCUIT_OPEN && now >= h->retry_at) {
+            release = 1;
+        }
+        if (release > max - taken) {
+            release = max - taken;
+        }
+
+        // Oldest first
+        memcpy(items + taken, h->parked, release * sizeof(queue_item_t));
+        for (int i = 0; i < release; i++) {
+            budget_release(MEM_QUEUE, parked_bytes(&h->parked[i]));
+        }
+        memmove(h->parked, h->parked + release, (h->parked_count - release) * sizeof(queue_item_t));
+        h->parked_count -= release;
+        parked_total -= release;
+        taken += release;
+
+        if (h->parked_count == 0) {
+            *link = h->next_parked;
+            h->next_parked = NULL;
+        } else {
+            link = &h->next_parked;
+        }
+    }
+    pthread_mutex_unlock(&hosts_mutex);
+    return taken;
+}
+
+// Family to try first for 'host', AF_UNSPEC if no connection won yet
+int host_preferred_family(const char *host) {
+    pthread_mutex_lock(&hosts_mutex);
+    host_health_t *h = lookup_locked(host, 0);
+    int family = h ? h->preferred_family : 0;
+    pthread_mutex_unlock(&hosts_mutex);
+    return family;
+}
+
+void host_remember_family(const char *host, int family) {
+    pthread_mutex_lock(&hosts_mutex);
+    lookup_locked(host, 1)->preferred_family = family;
+    pthread_mutex_unlock(&hosts_mutex);
+}
+
+/*
+ * Order resolved addresses for racing: the preferred family first, then
+ * alternating families (RFC 8305 section 4). Without a remembered
+ * winner IPv6 goes first.
+ */
+int order_addresses(struct addrinfo *res, int preferred, struct addrinfo **out, int max) {
+    struct addrinfo *first[HE_MAX_ATTEMPTS], *second[HE_MAX_ATTEMPTS];
+    int n_first = 0, n_second = 0, count = 0;
+
+    if (preferred == AF_UNSPEC) {
+        preferred = AF_INET6;
+    }
+    for (struct addrinfo *ai = res; ai != NULL; ai = ai->ai_next) {
+        if (ai->ai_family == preferred && n_first < HE_MAX_ATTEMPTS) {
+            first[n_first++] = ai;
+        } else if (ai->ai_family != preferred && n_second < HE_MAX_ATTEMPTS) {
+            second[n_second++] = ai;
+        }
+    }
+    for (int i = 0; count < max && (i < n_first || i < n_second); i++) {
+        if (i < n_first) {
+            out[count++] = first[i];
+        }
+        if (i < n_second && count < max) {
+            out[count++] = second[i];
+        }
+    }
+    return count;
+}
+
+int host_parked_count(void) {
+    pthread_mutex_lock(&hosts_mutex);
+    int count = parked_total;
+    pthread_mutex_unlock(&hosts_mutex);
+    return count;
+}
+
+void hosts_cleanup(void) {
+    pthread_mutex_lock(&hosts_mutex);
+    for (size_t i = 0; i < host_bucket_count; i++) {
+        host_health_t *h = host_table[i];
+        while (h) {
+            host_health_t *next = h->next;
+            for (int j = 0; j < h->parked_count; j++) {
+                budget_release(MEM_QUEUE, parked_bytes(&h->parked[j]));
+                free(h->parked[j].url);
+                free(h->parked[j].parent_url);
+            }
+            free(h->parked);
+            free(h->host);
+            free(h);
+            h = next;
+        }
+    }
+    free(host_table);
+    host_table = NULL;
+    host_bucket_count = 0;
+    host_count = 0;
+    parked_hosts = NULL;
+    parked_total = 0;
+    pthread_mutex_unlock(&hosts_mutex);
+}
+
+void hosts_print_stats(FILE *out) {
+    pthread_mutex_lock(&hosts_mutex);
+    fprintf(out, "Circuit breaker:\t%ld hosts seen, %ld circuits opened, %ld URLs parked, %d still parked\n",
+            hosts_seen, circuits_opened, urls_parked, parked_total);
+    fprintf(out, "  %ld hosts given up, %ld parked URLs dropped\n", hosts_given_up, urls_dropped);
+    pthread_mutex_unlock(&hosts_mutex);
+}
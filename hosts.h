@@ -0,0 +1,70 @@
+#ifndef HOSTS_H_
+#define HOSTS_H_
+
+#include <stdio.h>
+
+/*
+ * Per-host health tracking with a circuit breaker.
+ *
+ * After HOST_FAILURE_THRESHOLD consecutive failures or slow responses a
+ * host's circuit opens: its URLs are parked instead of fetched. Once the
+ * retry time passes one parked URL is released as a probe (half-open);
+ * success closes the circuit and releases the rest, failure reopens it
+ * with a doubled delay.
+ *
+ * A host whose circuit has opened host_give_up_openings times in a row
+ * is given up: its parked URLs are dropped and new ones are refused
+ * rather than parked, so a dead host cannot hold back the end of the
+ * crawl by probing its backlog one URL at a time. It is still re-probed
+ * every host_max_retry_ms with the next URL found for it, and a success
+ * closes the circuit again.
+ */
+
+#define HOST_INITIAL_BUCKETS 256        // Power of two, doubles with the host count
+#define HOST_FAILURE_THRESHOLD 3
+#define HOST_RETRY_MS 15000             // First delay before probing an open circuit
+#define HOST_MAX_RETRY_MS 600000        // Cap for the doubling delay
+#define HOST_GIVE_UP_OPENINGS 3         // Consecutive openings before dropping the backlog
+#define HE_MAX_ATTEMPTS 16              // Resolved addresses raced per connection
+
+typedef enum circuit_state {
+    CIRCUIT_CLOSED,
+    CIRCUIT_OPEN,
+    CIRCUIT_HALF_OPEN,
+    CIRCUIT_GIVEN_UP
+} circuit_state_t;
+
+typedef struct host_health {
+    struct host_health *next;           // Hash chain
+    struct host_health *next_parked;    // List of hosts holding parked URLs
+    char *host;
+    circuit_state_t state;
+    int failures;                       // Consecutive failures or slow responses
+    int open_count;                     // Consecutive openings, for backoff
+    long retry_at;                      // When an open circuit may be probed (ms)
+    struct queue_item *parked;          // URLs held back while not closed
+    int parked_count;
+    int parked_cap;
+    int preferred_family;               // Address family that last won a connection race
+} host_health_t;
+
+struct queue_item;
+struct addrinfo;
+
+// Tunables, set before the crawl starts
+extern long host_retry_ms;
+extern long host_max_retry_ms;
+extern int host_give_up_openings;       // 0 = never give up
+
+int host_admit_or_park(const char *host, struct queue_item *item);
+int host_report(const char *host, int ok);
+int host_take_parked(struct queue_item *items, int max);
+int host_parked_count(void);
+int host_preferred_family(const char *host);
+void host_remember_family(const char *host, int family);
+int order_addresses(struct addrinfo *res, int preferred, struct addrinfo **out, int max);
+void hosts_cleanup(void);
+void hosts_print_stats(FILE *out);
+long now_ms(void);
+
+#endif /* HOSTS_H_ */
@@ -0,0 +1,151 @@
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "seeds.h"
+
+/*
+ * Open a seed list. "-" reads stdin. With use_mmap the file is mapped
+ * and scanned in place; stdin and empty files fall back to stdio.
+ */
+int seed_reader_open(seed_reader_t *reader, const char *path, int use_mmap) {
+    memset(reader, 0, sizeof(*reader));
+
+    if (strcmp(path, "-") == 0) {
+        reader->file = stdin;
+        return 0;
+    }
+
+    if (use_mmap) {
+        int fd = open(path, O_RDONLY);
+        struct stat st;
+        if (fd < 0) {
+            fprintf(stderr, "Could not open seed file %s: %s\n", path, strerror(errno));
+            return -1;
+        }
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            reader->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (reader->map != MAP_FAILED) {
+                reader->map_len = st.st_size;
+                madvise(reader->map, reader->map_len, MADV_SEQUENTIAL);
+                close(fd);
+                return 0;
+            }
+            reader->map = NULL;
+        }
+        close(fd);
+    }
+
+    reader->file = fopen(path, "r");
+    if (reader->file == NULL) {
+        fprintf(stderr, "Could not open seed file %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// Return the next raw line (without newline) and its length, or NULL at EOF
+static const char *next_seed_line(seed_reader_t *reader, size_t *len) {
+    if (reader->map) {
+        if (reader->map_pos >= reader->map_len) {
+            return NULL;
+        }
+        const char *start = reader->map + reader->map_pos;
+        const char *nl = memchr(start, '\n', reader->map_len - reader->map_pos);
+        *len = nl ? (size_t)(nl - start) : reader->map_len - reader->map_pos;
+        reader->map_pos += *len + 1;
+        return start;
+    }
+
+    ssize_t n = getline(&reader->line, &reader->line_cap, reader->file);
+    if (n < 0) {
+        return NULL;
+    }
+    *len = n;
+    return reader->line;
+}
+
+// Host part of an absolute URL, for grouping
+static void host_span(const char *url, const char **host, size_t *len) {
+    const char *start = strstr(url, "://");
+    start = start ? start + 3 : url;
+    *host = start;
+    *len = strcspn(start, ":/?#");
+}
+
+static int compare_by_host(const void *a, const void *b) {
+    const char *url_a = *(const char **)a;
+    const char *url_b = *(const char **)b;
+    const char *host_a, *host_b;
+    size_t len_a, len_b;
+
+    host_span(url_a, &host_a, &len_a);
+    host_span(url_b, &host_b, &len_b);
+
+    int cmp = strncasecmp(host_a, host_b, len_a < len_b ? len_a : len_b);
+    if (cmp != 0) {
+        return cmp;
+    }
+    if (len_a != len_b) {
+        return len_a < len_b ? -1 : 1;
+    }
+    return strcmp(url_a, url_b);
+}
+
+/*
+ * Fill seeds[] with up to max malloc'd URLs, sorted by host.
+ * Returns the number of seeds, 0 at end of input.
+ */
+int seed_reader_next_batch(seed_reader_t *reader, char **seeds, int max) {
+    int count = 0;
+    const char *line;
+    size_t len;
+
+    while (count < max && (line = next_seed_line(reader, &len)) != NULL) {
+        // Trim surrounding whitespace, including '\r'
+        while (len > 0 && isspace((unsigned char)*line)) {
+            line++;
+            len--;
+        }
+        while (len > 0 && isspace((unsigned char)line[len - 1])) {
+            len--;
+        }
+        if (len == 0 || line[0] == '#') {
+            continue;
+        }
+
+        // Mapped lines are not NUL-terminated, so compare within len
+        if (!(len > 7 && memcmp(line, "http://", 7) == 0) &&
+            !(len > 8 && memcmp(line, "https://", 8) == 0)) {
+            fprintf(stderr, "Skipping seed that is not an http(s) URL: %.*s\n", (int)len, line);
+            continue;
+        }
+
+        seeds[count] = strndup(line, len);
+        count++;
+    }
+
+    qsort(seeds, count, sizeof(char *), compare_by_host);
+    reader->seeds_read += count;
+    return count;
+}
+
+void seed_reader_close(seed_reader_t *reader) {
+    if (reader->map) {
+        munmap(reader->map, reader->map_len);
+    }
+    if (reader->file && reader->file != stdin) {
+        fclose(reader->file);
+    }
+    free(reader->line);
+    memset(reader, 0, sizeof(*reader));
+}
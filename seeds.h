@@ -0,0 +1,29 @@
+#ifndef SEEDS_H_
+#define SEEDS_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+/*
+ * Streaming reader for seed lists: one URL per line, blank lines and
+ * lines starting with '#' ignored. Seeds come back in batches sorted by
+ * host so the same host is fetched in bursts.
+ */
+
+#define SEED_BATCH_SIZE 4096
+
+typedef struct seed_reader {
+    FILE *file;         // Stream being read, NULL when memory-mapped
+    char *map;          // Mapped file contents
+    size_t map_len;
+    size_t map_pos;
+    char *line;         // getline() buffer
+    size_t line_cap;
+    long seeds_read;
+} seed_reader_t;
+
+int seed_reader_open(seed_reader_t *reader, const char *path, int use_mmap);
+int seed_reader_next_batch(seed_reader_t *reader, char **seeds, int max);
+void seed_reader_close(seed_reader_t *reader);
+
+#endif /* SEEDS_H_ */
@@ -0,0 +1,580 @@
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "wgetX.h"
+#include "shard.h"
+#include "seeds.h"
+
+int shard_id = 0;
+int shard_count = 0;
+
+// Connection to the coordinator (shard side)
+static int coord_fd = -1;
+static pthread_t receiver_thread;
+static pthread_mutex_t send_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Outgoing batch of links owned by other shards
+static char *batch = NULL;
+static size_t batch_len = 0;
+static size_t batch_cap = 0;
+static struct timespec batch_started;
+
+// Peer state kept by the coordinator for every shard
+typedef struct shard_peer {
+    int fd;
+    char *in;           // Partial input line(s)
+    size_t in_len;
+    size_t in_cap;
+    char *out;          // Bytes not yet written to the shard
+    size_t out_len;
+    size_t out_cap;
+    long delivered;     // Links routed to this shard so far
+    long reported;      // Highest link count the shard reported idle at
+    int disconnected;   // Read EOF or failed; nothing more is written to it
+} shard_peer_t;
+
+// FNV-1a over the host name
+unsigned int shard_hash(const char *host, size_t len) {
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)host[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Map an absolute URL to the shard owning its host (port excluded)
+int shard_owner_of_url(const char *url) {
+    if (shard_count <= 0) {
+        return 0;
+    }
+
+    const char *host = strstr(url, "://");
+    host = host ? host + 3 : url;
+    size_t len = strcspn(host, ":/?#");
+    return shard_hash(host, len) % shard_count;
+}
+
+int shard_owns_url(const char *url) {
+    return shard_count <= 0 || shard_owner_of_url(url) == shard_id;
+}
+
+static long elapsed_ms(const struct timespec *since) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1000 + (now.tv_nsec - since->tv_nsec) / 1000000;
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Append to a growable buffer
+static void buffer_append(char **buf, size_t *len, size_t *cap, const char *data, size_t n) {
+    if (*len + n > *cap) {
+        size_t new_cap = *cap ? *cap : 4096;
+        while (new_cap < *len + n) {
+            new_cap *= 2;
+        }
+        char *temp = realloc(*buf, new_cap);
+        if (temp == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            exit(1);
+        }
+        *buf = temp;
+        *cap = new_cap;
+    }
+    memcpy(*buf + *len, data, n);
+    *len += n;
+}
+
+/* ---------------------------------------------------------------- */
+/* Shard side                                                        */
+/* ---------------------------------------------------------------- */
+
+// Read the "S <id> <count>" greeting from the coordinator
+int shard_join_fd(int fd) {
+    char line[64];
+    size_t len = 0;
+
+    while (len < sizeof(line) - 1) {
+        ssize_t n = read(fd, line + len, 1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            fprintf(stderr, "Coordinator closed the connection during startup\n");
+            return -1;
+        }
+        if (line[len] == '\n') {
+            break;
+        }
+        len++;
+    }
+    line[len] = '\0';
+
+    if (sscanf(line, "S %d %d", &shard_id, &shard_count) != 2 ||
+        shard_count <= 0 || shard_id < 0 || shard_id >= shard_count) {
+        fprintf(stderr, "Invalid coordinator greeting: %s\n", line);
+        return -1;
+    }
+
+    coord_fd = fd;
+    fprintf(stderr, "Joined as shard %d of %d\n", shard_id, shard_count);
+    return 0;
+}
+
+int shard_join_tcp(const char *host, int port) {
+    struct addrinfo hints, *res, *ai;
+    char port_str[6];
+
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(port_str, sizeof(port_str), "%d", port);
+
+    int status = getaddrinfo(host, port_str, &hints, &res);
+    if (status != 0) {
+        fprintf(stderr, "getaddrinfo error: %s\n", gai_strerror(status));
+        return -1;
+    }
+
+    int fd = -1;
+    for (ai = res; ai != NULL; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+
+    if (fd < 0) {
+        fprintf(stderr, "Could not connect to coordinator %s:%d\n", host, port);
+        return -1;
+    }
+    return shard_join_fd(fd);
+}
+
+// Must be called with send_mutex held
+static void flush_batch_locked(void) {
+    if (batch_len == 0) {
+        return;
+    }
+    if (write_all(coord_fd, batch, batch_len) < 0) {
+        fprintf(stderr, "Could not forward links to coordinator: %s\n", strerror(errno));
+    }
+    batch_len = 0;
+}
+
+void shard_forward_url(const char *url, int depth) {
+    char header[32];
+    int header_len = snprintf(header, sizeof(header), "L %d ", depth);
+
+    pthread_mutex_lock(&send_mutex);
+    if (batch_len == 0) {
+        clock_gettime(CLOCK_MONOTONIC, &batch_started);
+    }
+    buffer_append(&batch, &batch_len, &batch_cap, header, header_len);
+    buffer_append(&batch, &batch_len, &batch_cap, url, strlen(url));
+    buffer_append(&batch, &batch_len, &batch_cap, "\n", 1);
+    if (batch_len >= SHARD_BATCH_BYTES) {
+        flush_batch_locked();
+    }
+    pthread_mutex_unlock(&send_mutex);
+}
+
+void shard_flush_if_stale(void) {
+    pthread_mutex_lock(&send_mutex);
+    if (batch_len > 0 && elapsed_ms(&batch_started) >= SHARD_BATCH_DELAY_MS) {
+        flush_batch_locked();
+    }
+    pthread_mutex_unlock(&send_mutex);
+}
+
+/*
+ * Tell the coordinator this shard was idle after consuming 'received'
+ * links. Pending forwards go out first so the coordinator always routes
+ * them before it sees the idle report.
+ */
+void shard_report_idle(long received) {
+    char msg[32];
+    int len = snprintf(msg, sizeof(msg), "I %ld\n", received);
+
+    pthread_mutex_lock(&send_mutex);
+    flush_batch_locked();
+    if (write_all(coord_fd, msg, len) < 0) {
+        fprintf(stderr, "Could not report idle to coordinator: %s\n", strerror(errno));
+    }
+    pthread_mutex_unlock(&send_mutex);
+}
+
+static void *receiver_main(void *arg) {
+    char *buf = NULL;
+    size_t len = 0, cap = 0;
+    char chunk[65536];
+
+    while (1) {
+        ssize_t n = read(coord_fd, chunk, sizeof(chunk));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            fprintf(stderr, "Lost connection to coordinator\n");
+            break;
+        }
+        buffer_append(&buf, &len, &cap, chunk, n);
+
+        size_t start = 0;
+        char *nl;
+        int quit = 0;
+        while ((nl = memchr(buf + start, '\n', len - start)) != NULL) {
+            *nl = '\0';
+            char *line = buf + start;
+            start = nl - buf + 1;
+
+            int depth, offset;
+            if (line[0] == 'Q') {
+                quit = 1;
+                break;
+            } else if (sscanf(line, "L %d %n", &depth, &offset) == 1) {
+                accept_remote_url(line + offset, depth);
+            } else {
+                fprintf(stderr, "Unknown coordinator message: %s\n", line);
+            }
+        }
+        memmove(buf, buf + start, len - start);
+        len -= start;
+
+        if (quit) {
+            free(buf);
+            shutdown_url_queue();
+            return NULL;
+        }
+
+        // Links that were all duplicates never wake a worker
+        report_if_idle();
+    }
+
+    free(buf);
+    shutdown_url_queue();
+    return NULL;
+}
+
+int shard_start_receiver(void) {
+    if (pthread_create(&receiver_thread, NULL, receiver_main, NULL) != 0) {
+        fprintf(stderr, "Could not start shard receiver thread\n");
+        return -1;
+    }
+    return 0;
+}
+
+void shard_stop_receiver(void) {
+    pthread_join(receiver_thread, NULL);
+    close(coord_fd);
+    coord_fd = -1;
+    free(batch);
+    batch = NULL;
+    batch_len = batch_cap = 0;
+}
+
+/* ---------------------------------------------------------------- */
+/* Coordinator side                                                  */
+/* ---------------------------------------------------------------- */
+
+static void peer_send(shard_peer_t *peer, const char *data, size_t len) {
+    buffer_append(&peer->out, &peer->out_len, &peer->out_cap, data, len);
+}
+
+static void route_link(shard_peer_t *peers, int depth, const char *url) {
+    char header[32];
+    int header_len = snprintf(header, sizeof(header), "L %d ", depth);
+    shard_peer_t *owner = &peers[shard_owner_of_url(url)];
+
+    peer_send(owner, header, header_len);
+    peer_send(owner, url, strlen(url));
+    peer_send(owner, "\n", 1);
+    owner->delivered++;
+}
+
+// Parse every complete line received from a shard
+static void peer_handle_input(shard_peer_t *peers, shard_peer_t *peer) {
+    size_t start = 0;
+    char *nl;
+
+    while ((nl = memchr(peer->in + start, '\n', peer->in_len - start)) != NULL) {
+        *nl = '\0';
+        char *line = peer->in + start;
+        start = nl - peer->in + 1;
+
+        int depth, offset;
+        long received;
+        if (sscanf(line, "L %d %n", &depth, &offset) == 1) {
+            route_link(peers, depth, line + offset);
+        } else if (sscanf(line, "I %ld", &received) == 1) {
+            if (received > peer->reported) {
+                peer->reported = received;
+            }
+        } else {
+            fprintf(stderr, "Unknown shard message: %s\n", line);
+        }
+    }
+    memmove(peer->in, peer->in + start, peer->in_len - start);
+    peer->in_len -= start;
+}
+
+/*
+ * The crawl is over once every shard has reported idle after consuming
+ * everything routed to it: links only originate from busy shards, and a
+ * shard's forwards always precede its idle report on the same stream.
+ */
+static int all_quiescent(shard_peer_t *peers, int nshards) {
+    for (int i = 0; i < nshards; i++) {
+        if (peers[i].reported != peers[i].delivered) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static size_t pending_output(shard_peer_t *peers, int nshards) {
+    size_t total = 0;
+    for (int i = 0; i < nshards; i++) {
+        total += peers[i].out_len;
+    }
+    return total;
+}
+
+// Route the next batch of the seed list; returns 0 once it is exhausted
+static int route_seed_batch(shard_peer_t *peers, seed_reader_t *seeds) {
+    char *urls[SEED_BATCH_SIZE];
+    int count = seed_reader_next_batch(seeds, urls, SEED_BATCH_SIZE);
+
+    for (int i = 0; i < count; i++) {
+        route_link(peers, 0, urls[i]);
+        free(urls[i]);
+    }
+    if (count == 0) {
+        fprintf(stderr, "Coordinator: seed list done, %ld seeds routed\n", seeds->seeds_read);
+    }
+    return count > 0;
+}
+
+int coordinator_run(int *fds, int nshards, const char *seed, seed_reader_t *seeds) {
+    shard_peer_t *peers = calloc(nshards, sizeof(shard_peer_t));
+    struct pollfd *pfds = calloc(nshards, sizeof(struct pollfd));
+    int seeds_left = (seeds != NULL);
+    int result = 0;
+
+    shard_count = nshards;
+    for (int i = 0; i < nshards; i++) {
+        char greeting[32];
+        int len = snprintf(greeting, sizeof(greeting), "S %d %d\n", i, nshards);
+        peers[i].fd = fds[i];
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        peer_send(&peers[i], greeting, len);
+    }
+
+    if (seed) {
+        fprintf(stderr, "Coordinator: routing seed %s to shard %d\n", seed, shard_owner_of_url(seed));
+        route_link(peers, 0, seed);
+    }
+
+    while (1) {
+        // Top up the shards from the seed list while their backlog is small
+        while (seeds_left && pending_output(peers, nshards) < SHARD_SEED_BACKLOG) {
+            seeds_left = route_seed_batch(peers, seeds);
+        }
+        if (!seeds_left && all_quiescent(peers, nshards)) {
+            break;
+        }
+
+        for (int i = 0; i < nshards; i++) {
+            pfds[i].fd = peers[i].fd;
+            pfds[i].events = POLLIN | (peers[i].out_len > 0 ? POLLOUT : 0);
+            pfds[i].revents = 0;
+        }
+
+        if (poll(pfds, nshards, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "Coordinator poll error: %s\n", strerror(errno));
+            result = -1;
+            break;
+        }
+
+        for (int i = 0; i < nshards && result == 0; i++) {
+            shard_peer_t *peer = &peers[i];
+
+            if (pfds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                char chunk[65536];
+                ssize_t n = read(peer->fd, chunk, sizeof(chunk));
+                if (n > 0) {
+                    buffer_append(&peer->in, &peer->in_len, &peer->in_cap, chunk, n);
+                    peer_handle_input(peers, peer);
+                } else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+                    fprintf(stderr, "Coordinator: shard %d disconnected\n", i);
+                    peer->disconnected = 1;
+                    result = -1;
+                }
+            }
+
+            if ((pfds[i].revents & POLLOUT) && peer->out_len > 0) {
+                ssize_t n = write(peer->fd, peer->out, peer->out_len);
+                if (n > 0) {
+                    memmove(peer->out, peer->out + n, peer->out_len - n);
+                    peer->out_len -= n;
+                } else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                    fprintf(stderr, "Coordinator: write to shard %d failed: %s\n", i, strerror(errno));
+                    peer->disconnected = 1;
+                    result = -1;
+                }
+            }
+        }
+
+        if (result != 0) {
+            break;
+        }
+    }
+
+    fprintf(stderr, "Coordinator: %s, stopping %d shards\n",
+            result == 0 ? "all shards idle" : "aborting", nshards);
+    for (int i = 0; i < nshards; i++) {
+        if (!peers[i].disconnected) {
+            fcntl(peers[i].fd, F_SETFL, fcntl(peers[i].fd, F_GETFL) & ~O_NONBLOCK);
+            peer_send(&peers[i], "Q\n", 2);
+            write_all(peers[i].fd, peers[i].out, peers[i].out_len);
+        }
+        close(peers[i].fd);
+        free(peers[i].in);
+        free(peers[i].out);
+    }
+    free(peers);
+    free(pfds);
+    return result;
+}
+
+// Fork nshards crawler processes on this machine, linked by socket pairs
+int coordinator_run_local(int nshards, const char *seed, seed_reader_t *seeds, int (*shard_main)(void)) {
+    int *fds = calloc(nshards, sizeof(int));
+    pid_t *pids = calloc(nshards, sizeof(pid_t));
+
+    for (int i = 0; i < nshards; i++) {
+        int pair[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0) {
+            fprintf(stderr, "Could not create socket pair: %s\n", strerror(errno));
+            exit(1);
+        }
+
+        fflush(NULL);
+        pids[i] = fork();
+        if (pids[i] < 0) {
+            fprintf(stderr, "Could not fork shard %d: %s\n", i, strerror(errno));
+            exit(1);
+        }
+        if (pids[i] == 0) {
+            for (int j = 0; j < i; j++) {
+                close(fds[j]);
+            }
+            close(pair[0]);
+            if (shard_join_fd(pair[1]) < 0) {
+                _exit(1);
+            }
+            // _exit() leaves the parent's seed stream position alone
+            int status = shard_main();
+            fflush(stdout);
+            fflush(stderr);
+            _exit(status);
+        }
+
+        close(pair[1]);
+        fds[i] = pair[0];
+    }
+
+    int result = coordinator_run(fds, nshards, seed, seeds);
+
+    for (int i = 0; i < nshards; i++) {
+        int status;
+        waitpid(pids[i], &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            result = -1;
+        }
+    }
+    free(fds);
+    free(pids);
+    return result;
+}
+
+// Wait for nshards remote shards to connect, then coordinate them
+int coordinator_run_listen(int port, int nshards, const char *seed, seed_reader_t *seeds) {
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        fprintf(stderr, "Could not create socket: %s\n", strerror(errno));
+        return -1;
+    }
+
+    int one = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, nshards) < 0) {
+        fprintf(stderr, "Could not listen on port %d: %s\n", port, strerror(errno));
+        close(listen_fd);
+        return -1;
+    }
+
+    int *fds = calloc(nshards, sizeof(int));
+    for (int i = 0; i < nshards; i++) {
+        fprintf(stderr, "Coordinator: waiting for shard %d of %d on port %d\n", i, nshards, port);
+        fds[i] = accept(listen_fd, NULL, NULL);
+        if (fds[i] < 0) {
+            if (errno == EINTR) {
+                i--;
+                continue;
+            }
+            fprintf(stderr, "Could not accept shard: %s\n", strerror(errno));
+            close(listen_fd);
+            free(fds);
+            return -1;
+        }
+    }
+    close(listen_fd);
+
+    int result = coordinator_run(fds, nshards, seed, seeds);
+    free(fds);
+    return result;
+}
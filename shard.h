@@ -0,0 +1,48 @@
+#ifndef SHARD_H_
+#define SHARD_H_
+
+/*
+ * Host-hash sharding across several wgetX processes.
+ *
+ * Every shard owns the hosts whose hash maps to its id. Links for a
+ * foreign host are batched and handed to the coordinator, which routes
+ * them to the owning shard and detects global termination.
+ *
+ * Line protocol, in both directions over a stream socket:
+ *   coordinator -> shard:  "S <id> <count>"  startup, assigns the shard id
+ *                          "L <depth> <url>" link owned by this shard
+ *                          "Q"               crawl finished, shut down
+ *   shard -> coordinator:  "L <depth> <url>" link owned by another shard
+ *                          "I <received>"    idle after consuming <received> links
+ */
+
+#define SHARD_BATCH_BYTES 16384   // Flush forwarded links once the batch is this big
+#define SHARD_BATCH_DELAY_MS 200  // ... or once the oldest link waited this long
+#define SHARD_SEED_BACKLOG (1 << 20)  // Unsent bytes before the coordinator stops reading seeds
+
+struct seed_reader;
+
+/* Identity of this process; shard_count == 0 means unsharded */
+extern int shard_id;
+extern int shard_count;
+
+/* Ownership */
+unsigned int shard_hash(const char *host, size_t len);
+int shard_owner_of_url(const char *url);
+int shard_owns_url(const char *url);
+
+/* Shard side */
+int shard_join_fd(int fd);
+int shard_join_tcp(const char *host, int port);
+int shard_start_receiver(void);
+void shard_stop_receiver(void);
+void shard_forward_url(const char *url, int depth);
+void shard_flush_if_stale(void);
+void shard_report_idle(long received);
+
+/* Coordinator side */
+int coordinator_run(int *fds, int nshards, const char *seed, struct seed_reader *seeds);
+int coordinator_run_local(int nshards, const char *seed, struct seed_reader *seeds, int (*shard_main)(void));
+int coordinator_run_listen(int port, int nshards, const char *seed, struct seed_reader *seeds);
+
+#endif /* SHARD_H_ */
@@ -0,0 +1,29 @@
+#ifndef TEST_H_
+#define TEST_H_
+
+#include <stdio.h>
+
+/*
+ * Minimal check helpers shared by the test_*.c programs: CHECK records a
+ * failure and keeps going, test_report() prints the verdict for main().
+ */
+
+static int test_failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        test_failures++; \
+    } \
+} while (0)
+
+static inline int test_report(const char *name) {
+    if (test_failures) {
+        printf("%s: %d failures\n", name, test_failures);
+        return 1;
+    }
+    printf("%s: OK\n", name);
+    return 0;
+}
+
+#endif /* TEST_H_ */
@@ -0,0 +1,215 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<unistd.h>
+#include<sys/socket.h>
+#include<netdb.h>
+#include"wgetX.h"
+#include"hosts.h"
+#include"test.h"
+
+#define RETRY_MS 20
+
+// Chain n fake resolver results with the given families
+static struct addrinfo *make_list(struct addrinfo *nodes, const int *families, int n) {
+    memset(nodes, 0, n * sizeof(struct addrinfo));
+    for (int i = 0; i < n; i++) {
+        nodes[i].ai_family = families[i];
+        nodes[i].ai_next = i + 1 < n ? &nodes[i + 1] : NULL;
+    }
+    return n > 0 ? nodes : NULL;
+}
+
+// Without a remembered family IPv6 leads, then families alternate
+static void test_default_order(void) {
+    const int families[] = { AF_INET, AF_INET, AF_INET6, AF_INET6, AF_INET6 };
+    struct addrinfo nodes[5], *out[HE_MAX_ATTEMPTS];
+    struct addrinfo *res = make_list(nodes, families, 5);
+
+    CHECK(order_addresses(res, AF_UNSPEC, out, HE_MAX_ATTEMPTS) == 5);
+    CHECK(out[0] == &nodes[2]);
+    CHECK(out[1] == &nodes[0]);
+    CHECK(out[2] == &nodes[3]);
+    CHECK(out[3] == &nodes[1]);
+    CHECK(out[4] == &nodes[4]);
+}
+
+// A remembered winner goes first
+static void test_preferred(void) {
+    const int families[] = { AF_INET6, AF_INET, AF_INET6, AF_INET };
+    struct addrinfo nodes[4], *out[HE_MAX_ATTEMPTS];
+    struct addrinfo *res = make_list(nodes, families, 4);
+
+    CHECK(order_addresses(res, AF_INET, out, HE_MAX_ATTEMPTS) == 4);
+    CHECK(out[0] == &nodes[1]);
+    CHECK(out[1] == &nodes[0]);
+    CHECK(out[2] == &nodes[3]);
+    CHECK(out[3] == &nodes[2]);
+}
+
+// Single family lists keep resolver order; max and empty lists are honoured
+static void test_limits(void) {
+    const int families[] = { AF_INET, AF_INET, AF_INET };
+    struct addrinfo nodes[3], *out[HE_MAX_ATTEMPTS];
+    struct addrinfo *res = make_list(nodes, families, 3);
+
+    CHECK(order_addresses(res, AF_UNSPEC, out, HE_MAX_ATTEMPTS) == 3);
+    CHECK(out[0] == &nodes[0] && out[1] == &nodes[1] && out[2] == &nodes[2]);
+    CHECK(order_addresses(res, AF_UNSPEC, out, 2) == 2);
+    CHECK(order_addresses(NULL, AF_INET, out, HE_MAX_ATTEMPTS) == 0);
+}
+
+// The host table grows past its initial buckets without losing entries
+static void test_many_hosts(void) {
+    char host[32];
+    int count = HOST_INITIAL_BUCKETS * 20;
+
+    for (int i = 0; i < count; i++) {
+        snprintf(host, sizeof(host), "h%d.example", i);
+        host_remember_family(host, i % 2 ? AF_INET : AF_INET6);
+    }
+    int found = 0;
+    for (int i = 0; i < count; i++) {
+        snprintf(host, sizeof(host), "h%d.example", i);
+        found += host_preferred_family(host) == (i % 2 ? AF_INET : AF_INET6);
+    }
+    CHECK(found == count);
+    CHECK(host_preferred_family("unknown.example") == AF_UNSPEC);
+    hosts_cleanup();
+    CHECK(host_preferred_family("h1.example") == AF_UNSPEC);
+}
+
+static queue_item_t make_item(const char *url) {
+    queue_item_t item = { strdup(url), NULL, 0 };
+    return item;
+}
+
+// Admit a URL; a fetchable one is freed as if the worker fetched it
+static int admit(const char *host, const char *url) {
+    queue_item_t item = make_item(url);
+    int admitted = host_admit_or_park(host, &item);
+    if (admitted != 0) {
+        free(item.url);
+    }
+    return admitted;
+}
+
+static int take_parked(void) {
+    queue_item_t items[8];
+    int count = host_take_parked(items, 8);
+    for (int i = 0; i < count; i++) {
+        free(items[i].url);
+        free(items[i].parent_url);
+    }
+    return count;
+}
+
+static void fail(const char *host, int times) {
+    for (int i = 0; i < times; i++) {
+        CHECK(host_report(host, 0) == 0);
+    }
+}
+
+static void wait_retry(void) {
+    usleep((RETRY_MS + 10) * 1000);
+}
+
+// closed -> open -> half-open -> closed, parked URLs released in between
+static void test_circuit_recovers(void) {
+    const char *host = "recovers.example";
+
+    CHECK(admit(host, "http://recovers.example/1") == 1);
+    fail(host, HOST_FAILURE_THRESHOLD - 1);
+    CHECK(admit(host, "http://recovers.example/2") == 1);
+    fail(host, 1);
+
+    // Open: URLs wait, nothing is released before the retry time
+    CHECK(admit(host, "http://recovers.example/3") == 0);
+    CHECK(admit(host, "http://recovers.example/4") == 0);
+    CHECK(host_parked_count() == 2);
+    CHECK(take_parked() == 0);
+
+    // One probe once the retry time passed, the rest stays parked
+    wait_retry();
+    queue_item_t probe[8];
+    CHECK(host_take_parked(probe, 8) == 1);
+    CHECK(strcmp(probe[0].url, "http://recovers.example/3") == 0);
+    CHECK(host_admit_or_park(host, &probe[0]) == 1);
+    free(probe[0].url);
+    CHECK(admit(host, "http://recovers.example/5") == 0);
+    CHECK(take_parked() == 0);
+
+    // The probe succeeded: everything parked comes back
+    CHECK(host_report(host, 1) == 0);
+    CHECK(take_parked() == 2);
+    CHECK(host_parked_count() == 0);
+    CHECK(admit(host, "http://recovers.example/6") == 1);
+}
+
+// A failed probe reopens; enough openings drop the backlog, re-probing continues
+static void test_circuit_gives_up(void) {
+    const char *host = "gives-up.example";
+
+    fail(host, HOST_FAILURE_THRESHOLD);
+    for (int opening = 1; opening < HOST_GIVE_UP_OPENINGS; opening++) {
+        CHECK(admit(host, "http://gives-up.example/parked") == 0);
+        wait_retry();
+        CHECK(admit(host, "http://gives-up.example/probe") == 1);
+        if (opening + 1 < HOST_GIVE_UP_OPENINGS) {
+            fail(host, 1);
+        }
+    }
+    CHECK(host_parked_count() == HOST_GIVE_UP_OPENINGS - 1);
+
+    // Given up: the backlog is dropped and new URLs are refused
+    CHECK(host_report(host, 0) == HOST_GIVE_UP_OPENINGS - 1);
+    CHECK(host_parked_count() == 0);
+    CHECK(admit(host, "http://gives-up.example/refused") == -1);
+
+    // Still probed at the capped interval; a failure keeps it given up
+    wait_retry();
+    CHECK(admit(host, "http://gives-up.example/probe") == 1);
+    CHECK(admit(host, "http://gives-up.example/during-probe") == 0);
+    CHECK(host_report(host, 0) == 1);
+    CHECK(admit(host, "http://gives-up.example/refused") == -1);
+
+    // A success brings it back for good
+    wait_retry();
+    CHECK(admit(host, "http://gives-up.example/probe") == 1);
+    CHECK(host_report(host, 1) == 0);
+    CHECK(admit(host, "http://gives-up.example/back") == 1);
+    CHECK(host_parked_count() == 0);
+}
+
+// With giving up disabled a host keeps its backlog through any number of openings
+static void test_never_give_up(void) {
+    const char *host = "never.example";
+
+    host_give_up_openings = 0;
+    fail(host, HOST_FAILURE_THRESHOLD);
+    for (int opening = 0; opening < 2 * HOST_GIVE_UP_OPENINGS; opening++) {
+        CHECK(admit(host, "http://never.example/parked") == 0);
+        wait_retry();
+        CHECK(admit(host, "http://never.example/probe") == 1);
+        fail(host, 1);
+    }
+    CHECK(host_parked_count() == 2 * HOST_GIVE_UP_OPENINGS);
+    host_give_up_openings = HOST_GIVE_UP_OPENINGS;
+    hosts_cleanup();
+}
+
+int main(void) {
+    test_default_order();
+    test_preferred();
+    test_limits();
+    test_many_hosts();
+
+    host_retry_ms = RETRY_MS;
+    host_max_retry_ms = RETRY_MS;
+    test_circuit_recovers();
+    test_circuit_gives_up();
+    test_never_give_up();
+    hosts_cleanup();
+
+    return test_report("test_hosts");
+}
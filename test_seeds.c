@@ -0,0 +1,104 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<unistd.h>
+#include"seeds.h"
+#include"test.h"
+
+// Write contents to a temporary file and return its path
+static char *write_temp(const char *contents, size_t len) {
+    char *path = strdup("/tmp/test_seeds-XXXXXX");
+    int fd = mkstemp(path);
+    if (fd < 0 || write(fd, contents, len) != (ssize_t)len) {
+        perror("temp file");
+        exit(1);
+    }
+    close(fd);
+    return path;
+}
+
+static int read_all(const char *path, int use_mmap, char **seeds, int max) {
+    seed_reader_t reader;
+    if (seed_reader_open(&reader, path, use_mmap) != 0) {
+        return -1;
+    }
+    int count = seed_reader_next_batch(&reader, seeds, max);
+    CHECK(seed_reader_next_batch(&reader, seeds + count, max - count) == 0);
+    CHECK(reader.seeds_read == count);
+    seed_reader_close(&reader);
+    return count;
+}
+
+static void free_seeds(char **seeds, int count) {
+    for (int i = 0; i < count; i++) {
+        free(seeds[i]);
+    }
+}
+
+// Trimming, comments, CRLF, non-http lines and host ordering
+static void test_parsing(int use_mmap) {
+    const char contents[] =
+        "# comment line\n"
+        "\n"
+        "  http://b.example/one  \n"
+        "https://a.example/two\r\n"
+        "ftp://a.example/skipped\n"
+        "http://\n"
+        "\thttp://A.example/three\n"
+        "   \n"
+        "http://b.example:8080/four";      // No trailing newline
+    char *path = write_temp(contents, sizeof(contents) - 1);
+    char *seeds[16];
+
+    int count = read_all(path, use_mmap, seeds, 16);
+    CHECK(count == 4);
+    if (count == 4) {
+        // Hosts compare case-insensitively, then whole URLs break ties
+        CHECK(strcmp(seeds[0], "http://A.example/three") == 0);
+        CHECK(strcmp(seeds[1], "https://a.example/two") == 0);
+        CHECK(strcmp(seeds[2], "http://b.example/one") == 0);
+        CHECK(strcmp(seeds[3], "http://b.example:8080/four") == 0);
+    }
+    free_seeds(seeds, count);
+    unlink(path);
+    free(path);
+}
+
+// Batches stop at max and carry on where they left off
+static void test_batches(void) {
+    const char contents[] = "http://c/1\nhttp://b/2\nhttp://a/3\n";
+    char *path = write_temp(contents, sizeof(contents) - 1);
+    seed_reader_t reader;
+    char *seeds[2];
+
+    CHECK(seed_reader_open(&reader, path, 1) == 0);
+    CHECK(seed_reader_next_batch(&reader, seeds, 2) == 2);
+    CHECK(strcmp(seeds[0], "http://b/2") == 0 && strcmp(seeds[1], "http://c/1") == 0);
+    free_seeds(seeds, 2);
+    CHECK(seed_reader_next_batch(&reader, seeds, 2) == 1);
+    CHECK(strcmp(seeds[0], "http://a/3") == 0);
+    free_seeds(seeds, 1);
+    CHECK(seed_reader_next_batch(&reader, seeds, 2) == 0);
+    CHECK(reader.seeds_read == 3);
+    seed_reader_close(&reader);
+    unlink(path);
+    free(path);
+}
+
+// Empty files cannot be mapped and fall back to stdio
+static void test_empty(void) {
+    char *path = write_temp("", 0);
+    char *seeds[1];
+    CHECK(read_all(path, 1, seeds, 1) == 0);
+    unlink(path);
+    free(path);
+}
+
+int main(void) {
+    test_parsing(0);
+    test_parsing(1);
+    test_batches();
+    test_empty();
+
+    return test_report("test_seeds");
+}
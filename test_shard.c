@@ -0,0 +1,57 @@
+#include<stdio.h>
+#include<string.h>
+#include"shard.h"
+#include"test.h"
+
+// The receiver thread calls back into the crawler; unused here
+void accept_remote_url(const char *url, int depth) {}
+void report_if_idle(void) {}
+void shutdown_url_queue(void) {}
+
+static void test_unsharded(void) {
+    shard_count = 0;
+    shard_id = 0;
+    CHECK(shard_owner_of_url("http://a.example/") == 0);
+    CHECK(shard_owns_url("http://a.example/"));
+}
+
+// Only the host decides the owner: scheme, port, path and query do not
+static void test_host_only(void) {
+    shard_count = 7;
+    int owner = shard_owner_of_url("http://a.example/");
+    CHECK(owner >= 0 && owner < 7);
+    CHECK(shard_owner_of_url("https://a.example/x/y.html") == owner);
+    CHECK(shard_owner_of_url("http://a.example:8080/") == owner);
+    CHECK(shard_owner_of_url("http://a.example?q=1") == owner);
+    CHECK(shard_owner_of_url("http://a.example#top") == owner);
+    CHECK(shard_owner_of_url("a.example/no-scheme") == owner);
+    CHECK(owner == (int)(shard_hash("a.example", 9) % 7));
+}
+
+// Exactly one shard owns each URL, and hosts spread over all shards
+static void test_spread(void) {
+    int hits[4] = {0};
+    char url[64];
+
+    shard_count = 4;
+    for (int i = 0; i < 400; i++) {
+        snprintf(url, sizeof(url), "http://host%d.example/", i);
+        int owners = 0;
+        for (shard_id = 0; shard_id < shard_count; shard_id++) {
+            owners += shard_owns_url(url);
+        }
+        CHECK(owners == 1);
+        hits[shard_owner_of_url(url)]++;
+    }
+    for (int i = 0; i < 4; i++) {
+        CHECK(hits[i] > 50);
+    }
+}
+
+int main(void) {
+    test_unsharded();
+    test_host_only();
+    test_spread();
+
+    return test_report("test_shard");
+}
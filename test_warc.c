@@ -0,0 +1,138 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<unistd.h>
+#include"wgetX.h"
+#include"warc.h"
+#include"test.h"
+
+#define PREFIX "/tmp/test_warc"
+
+static void check_key(const char *url, const char *expected) {
+    char key[256];
+    cdx_url_key(url, key, sizeof(key));
+    if (strcmp(key, expected) != 0) {
+        printf("key for %s: got %s, want %s\n", url, key, expected);
+    }
+    CHECK(strcmp(key, expected) == 0);
+}
+
+static void test_keys(void) {
+    check_key("http://www.Example.com/A/b.html", "com,example)/a/b.html");
+    check_key("https://example.com", "com,example)/");
+    check_key("http://example.com:80/x", "com,example)/x");
+    check_key("https://example.com:443/x", "com,example)/x");
+    check_key("http://example.com:8/x", "com,example:8)/x");
+    check_key("http://example.com:8080?q=1#frag", "com,example:8080)/?q=1");
+    check_key("http://sub.example.org/a b", "org,example,sub)/a%20b");
+    check_key("http://localhost/", "localhost)/");
+    check_key("http://127.0.0.1:8080/x", "127.0.0.1:8080)/x");
+    check_key("http://[::1]:80/x", "[::1])/x");
+
+    // Never past the buffer, always terminated
+    char small[8];
+    cdx_url_key("http://www.example.com/long/path", small, sizeof(small));
+    CHECK(strcmp(small, "com,exa") == 0);
+}
+
+// Queue one exchange the way the worker does: buffers move into the writer
+static void write_exchange(const char *url, const char *body) {
+    http_reply reply = {0};
+    char head[] = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n\r\n";
+
+    reply.reply_buffer_size = strlen(head) + strlen(body) + 1;
+    reply.reply_buffer = malloc(reply.reply_buffer_size);
+    sprintf(reply.reply_buffer, "%s%s", head, body);
+    reply.reply_buffer_length = strlen(reply.reply_buffer);
+    reply.request = strdup("GET / HTTP/1.1\r\n\r\n");
+    warc_write_exchange(url, &reply);
+    CHECK(reply.reply_buffer == NULL && reply.request == NULL);
+}
+
+// Parse records back: each Content-Length must end exactly at the record's CRLFCRLF
+static int check_records(const char *path, const char *long_url) {
+    FILE *file = fopen(path, "rb");
+    CHECK(file != NULL);
+    if (file == NULL) {
+        return 0;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    rewind(file);
+    char *data = malloc(size + 1);
+    CHECK(fread(data, 1, size, file) == (size_t)size);
+    data[size] = '\0';
+    fclose(file);
+
+    int records = 0, found_long = 0;
+    long pos = 0;
+    while (pos < size) {
+        char *header_end = strstr(data + pos, "\r\n\r\n");
+        CHECK(header_end != NULL && strncmp(data + pos, "WARC/1.0\r\n", 10) == 0);
+        if (header_end == NULL) {
+            break;
+        }
+        *header_end = '\0';
+        char *length_field = strstr(data + pos, "\r\nContent-Length: ");
+        CHECK(length_field != NULL);
+        if (length_field == NULL) {
+            break;
+        }
+        long length = atol(length_field + 18);
+        char *uri = strstr(data + pos, "\r\nWARC-Target-URI: ");
+        if (uri && strncmp(uri + 19, long_url, strlen(long_url)) == 0) {
+            found_long = 1;
+        }
+
+        pos = header_end - data + 4 + length;
+        CHECK(pos + 4 <= size && memcmp(data + pos, "\r\n\r\n", 4) == 0);
+        pos += 4;
+        records++;
+    }
+    CHECK(found_long);
+    free(data);
+    return records;
+}
+
+static void test_archive(void) {
+    // Longer than any fixed header buffer
+    char *long_url = malloc(6000);
+    strcpy(long_url, "http://b.example/");
+    memset(long_url + 17, 'x', 5900);
+    long_url[5917] = '\0';
+
+    CHECK(warc_open(PREFIX, WARC_DEFAULT_MAX_SIZE, 0) == 0);
+    write_exchange(long_url, "<html>long</html>");
+    write_exchange("http://www.a.example/page", "<html>a</html>");
+    write_exchange("http://c.example/", "<html>c</html>");
+    warc_close();
+
+    // warcinfo plus a request and a response per exchange
+    CHECK(check_records(PREFIX "-00000.warc", long_url) == 7);
+
+    // Index is sorted by key, header first
+    FILE *cdx = fopen(PREFIX ".cdx", "r");
+    CHECK(cdx != NULL);
+    if (cdx) {
+        char *line = NULL;
+        size_t cap = 0;
+        char expect[][32] = { " CDX N b a m s S V g", "example,a)/page ", "example,b)/xxx", "example,c)/ " };
+        for (int i = 0; i < 4; i++) {
+            CHECK(getline(&line, &cap, cdx) > 0 && strncmp(line, expect[i], strlen(expect[i])) == 0);
+        }
+        CHECK(getline(&line, &cap, cdx) < 0);
+        free(line);
+        fclose(cdx);
+    }
+
+    unlink(PREFIX "-00000.warc");
+    unlink(PREFIX ".cdx");
+    free(long_url);
+}
+
+int main(void) {
+    test_keys();
+    test_archive();
+
+    return test_report("test_warc");
+}
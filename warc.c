@@ -0,0 +1,535 @@
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/random.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <zlib.h>
+
+#include "warc.h"
+#include "wgetX.h"
+#include "budget.h"
+
+/* One fetched exchange waiting for the writer thread */
+typedef struct warc_job {
+    struct warc_job *next;
+    char *url;
+    time_t fetched;
+    char *request;          // Request as sent
+    char *reply;            // Reply headers, plus the body unless spilled
+    int reply_length;
+    size_t reply_size;      // Bytes charged to MEM_WRITE
+    char *spill_path;       // Body on disk, streamed into the record
+    long spill_length;
+} warc_job_t;
+
+static warc_job_t *queue_head = NULL;
+static warc_job_t *queue_tail = NULL;
+static pthread_mutex_t warc_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t warc_ready = PTHREAD_COND_INITIALIZER;
+static pthread_t writer_thread;
+static int enabled = 0;
+static int closing = 0;
+
+// Output state, only touched by the writer thread once started
+static char *warc_prefix = NULL;
+static size_t warc_max_size = WARC_DEFAULT_MAX_SIZE;
+static int warc_gzip = 0;
+static FILE *warc_file = NULL;
+static char warc_name[1024];
+static int warc_index = 0;
+static FILE *cdx_file = NULL;
+static char cdx_name[1024];
+static z_stream zs;
+static unsigned char zbuf[WARC_COPY_CHUNK];
+
+// Counters, read by warc_print_stats() under warc_mutex
+static long records_written = 0;
+static long long bytes_written = 0;
+static int files_written = 0;
+
+int warc_enabled(void) {
+    return enabled;
+}
+
+static void make_record_id(char *out, size_t len) {
+    unsigned char b[16];
+    if (getrandom(b, sizeof(b), 0) != sizeof(b)) {
+        for (size_t i = 0; i < sizeof(b); i++) {
+            b[i] = rand();
+        }
+    }
+    b[6] = (b[6] & 0x0f) | 0x40;    // Version 4
+    b[8] = (b[8] & 0x3f) | 0x80;    // RFC 4122 variant
+    snprintf(out, len,
+             "<urn:uuid:%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x>",
+             b[0], b[1], b[2], b[3], b[4], b[5], b[6], b[7],
+             b[8], b[9], b[10], b[11], b[12], b[13], b[14], b[15]);
+}
+
+/* Record output, one gzip member per record when compressing */
+
+static void record_begin(void) {
+    if (warc_gzip) {
+        memset(&zs, 0, sizeof(zs));
+        deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+    }
+}
+
+static void record_put(const void *data, size_t len) {
+    if (!warc_gzip) {
+        fwrite(data, 1, len, warc_file);
+        return;
+    }
+
+    zs.next_in = (unsigned char *)data;
+    zs.avail_in = len;
+    while (zs.avail_in > 0) {
+        zs.next_out = zbuf;
+        zs.avail_out = sizeof(zbuf);
+        deflate(&zs, Z_NO_FLUSH);
+        fwrite(zbuf, 1, sizeof(zbuf) - zs.avail_out, warc_file);
+    }
+}
+
+static void record_end(void) {
+    if (!warc_gzip) {
+        return;
+    }
+
+    int ret;
+    do {
+        zs.next_out = zbuf;
+        zs.avail_out = sizeof(zbuf);
+        ret = deflate(&zs, Z_FINISH);
+        fwrite(zbuf, 1, sizeof(zbuf) - zs.avail_out, warc_file);
+    } while (ret == Z_OK);
+    deflateEnd(&zs);
+}
+
+/*
+ * Append one record whose block is 'block' followed by the contents of
+ * 'spill_path', if any. Returns the record's offset and stored length.
+ */
+static void write_record(const char *type, const char *url, const char *date,
+                         const char *record_id, const char *concurrent_to,
+                         const char *content_type, const char *block, size_t block_len,
+                         const char *spill_path, long spill_length,
+                         long *offset, long *length) {
+    // Fixed field names and the length digits fit in the slack
+    size_t header_size = 256 + strlen(type) + strlen(record_id) + strlen(date) +
+                         strlen(content_type) + (url ? strlen(url) : 0) +
+                         (concurrent_to ? strlen(concurrent_to) : 0);
+    char *header = malloc(header_size);
+    int header_len = snprintf(header, header_size,
+                              "WARC/1.0\r\n"
+                              "WARC-Type: %s\r\n"
+                              "WARC-Record-ID: %s\r\n"
+                              "WARC-Date: %s\r\n",
+                              type, record_id, date);
+    if (url) {
+        header_len += snprintf(header + header_len, header_size - header_len,
+                               "WARC-Target-URI: %s\r\n", url);
+    }
+    if (concurrent_to) {
+        header_len += snprintf(header + header_len, header_size - header_len,
+                               "WARC-Concurrent-To: %s\r\n", concurrent_to);
+    }
+    header_len += snprintf(header + header_len, header_size - header_len,
+                           "Content-Type: %s\r\n"
+                           "Content-Length: %ld\r\n"
+                           "\r\n",
+                           content_type, (long)block_len + spill_length);
+
+    *offset = ftello(warc_file);
+    record_begin();
+    record_put(header, header_len);
+    record_put(block, block_len);
+    free(header);
+
+    if (spill_path) {
+        FILE *spill = fopen(spill_path, "rb");
+        if (spill == NULL) {
+            fprintf(stderr, "Could not read spilled body %s: %s\n", spill_path, strerror(errno));
+        } else {
+            char chunk[WARC_COPY_CHUNK];
+            size_t n;
+            while ((n = fread(chunk, 1, sizeof(chunk), spill)) > 0) {
+                record_put(chunk, n);
+            }
+            fclose(spill);
+        }
+    }
+
+    record_put("\r\n\r\n", 4);
+    record_end();
+    *length = ftello(warc_file) - *offset;
+
+    pthread_mutex_lock(&warc_mutex);
+    records_written++;
+    bytes_written += *length;
+    pthread_mutex_unlock(&warc_mutex);
+}
+
+static void format_dates(time_t when, char *warc_date, size_t warc_len, char *cdx_date, size_t cdx_len) {
+    struct tm tm;
+    gmtime_r(&when, &tm);
+    strftime(warc_date, warc_len, "%Y-%m-%dT%H:%M:%SZ", &tm);
+    strftime(cdx_date, cdx_len, "%Y%m%d%H%M%S", &tm);
+}
+
+static int open_next_file(void) {
+    if (warc_file) {
+        fclose(warc_file);
+    }
+
+    snprintf(warc_name, sizeof(warc_name), "%s-%05d.warc%s", warc_prefix, warc_index++, warc_gzip ? ".gz" : "");
+    warc_file = fopen(warc_name, "wb");
+    if (warc_file == NULL) {
+        fprintf(stderr, "Could not open WARC file %s: %s\n", warc_name, strerror(errno));
+        return -1;
+    }
+    fprintf(stderr, "Writing WARC file %s\n", warc_name);
+
+    char record_id[64], date[32], cdx_date[16];
+    char info[256];
+    long offset, length;
+    make_record_id(record_id, sizeof(record_id));
+    format_dates(time(NULL), date, sizeof(date), cdx_date, sizeof(cdx_date));
+    int info_len = snprintf(info, sizeof(info),
+                            "software: wgetX\r\n"
+                            "format: WARC File Format 1.0\r\n");
+    write_record("warcinfo", NULL, date, record_id, NULL, "application/warc-fields",
+                 info, info_len, NULL, 0, &offset, &length);
+
+    pthread_mutex_lock(&warc_mutex);
+    files_written++;
+    pthread_mutex_unlock(&warc_mutex);
+    return 0;
+}
+
+// Media type of a reply without parameters, for the CDX line
+static void reply_mime(const warc_job_t *job, char *out, size_t len) {
+    const char *ct = strcasestr(job->reply, "\r\nContent-Type:");
+    size_t n = 0;
+
+    if (ct) {
+        ct += 15;
+        while (*ct == ' ' || *ct == '\t') {
+            ct++;
+        }
+        while (ct[n] && ct[n] != ';' && ct[n] != '\r' && !isspace((unsigned char)ct[n]) && n < len - 1) {
+            out[n] = tolower((unsigned char)ct[n]);
+            n++;
+        }
+    }
+    if (n == 0) {
+        out[n++] = '-';
+    }
+    out[n] = '\0';
+}
+
+// Append to out, always NUL-terminated and never past len
+static void key_append(char *out, size_t len, size_t *n, const char *s, size_t slen) {
+    while (slen-- > 0 && *n + 1 < len) {
+        out[(*n)++] = *s++;
+    }
+    out[*n] = '\0';
+}
+
+/*
+ * Canonical index key in SURT form: scheme and "www." dropped, host
+ * labels reversed, default ports removed, lower case, no fragment, and
+ * spaces escaped so the key stays one CDX field.
+ * "http://www.Example.com:80/A b?x" -> "com,example)/a%20b?x"
+ */
+void cdx_url_key(const char *url, char *out, size_t len) {
+    size_t n = 0;
+    char *lower = strdup(url);
+    for (char *p = lower; *p; p++) {
+        *p = tolower((unsigned char)*p);
+    }
+
+    const char *host = strstr(lower, "://");
+    host = host ? host + 3 : lower;
+    if (strncmp(host, "www.", 4) == 0) {
+        host += 4;
+    }
+    size_t host_len = strcspn(host, ":/?#");
+    if (host[0] == '[') {
+        host_len = strcspn(host, "]/?#");
+        host_len += (host[host_len] == ']');
+    }
+    const char *rest = host + host_len;
+
+    // Labels last to first; addresses stay as they are
+    int is_address = host[0] == '[' || strspn(host, "0123456789.") >= host_len;
+    if (is_address) {
+        key_append(out, len, &n, host, host_len);
+    }
+    const char *label_end = is_address ? host : host + host_len;
+    while (label_end > host) {
+        const char *label = label_end;
+        while (label > host && label[-1] != '.') {
+            label--;
+        }
+        key_append(out, len, &n, label, label_end - label);
+        if (label > host) {
+            key_append(out, len, &n, ",", 1);
+            label--;
+        }
+        label_end = label;
+    }
+
+    if (*rest == ':') {
+        size_t port_len = strcspn(rest, "/?#");
+        int default_port = (port_len == 3 && memcmp(rest, ":80", 3) == 0) ||
+                           (port_len == 4 && memcmp(rest, ":443", 4) == 0);
+        if (!default_port) {
+            key_append(out, len, &n, rest, port_len);
+        }
+        rest += port_len;
+    }
+    key_append(out, len, &n, ")", 1);
+    if (*rest != '/') {
+        key_append(out, len, &n, "/", 1);
+    }
+    for (; *rest && *rest != '#'; rest++) {
+        if (*rest == ' ') {
+            key_append(out, len, &n, "%20", 3);
+        } else {
+            key_append(out, len, &n, rest, 1);
+        }
+    }
+    free(lower);
+}
+
+// A URL as one CDX field: spaces and line breaks escaped
+static void put_cdx_url(const char *url) {
+    for (; *url; url++) {
+        if (*url == ' ' || *url == '\r' || *url == '\n') {
+            fprintf(cdx_file, "%%%02X", (unsigned char)*url);
+        } else {
+            fputc(*url, cdx_file);
+        }
+    }
+}
+
+static void write_job(warc_job_t *job) {
+    if (warc_file == NULL || ftello(warc_file) >= (off_t)warc_max_size) {
+        if (open_next_file() != 0) {
+            return;
+        }
+    }
+
+    char request_id[64], response_id[64], date[32], cdx_date[16];
+    long offset, length;
+    make_record_id(request_id, sizeof(request_id));
+    make_record_id(response_id, sizeof(response_id));
+    format_dates(job->fetched, date, sizeof(date), cdx_date, sizeof(cdx_date));
+
+    if (job->request) {
+        write_record("request", job->url, date, request_id, response_id,
+                     "application/http; msgtype=request",
+                     job->request, strlen(job->request), NULL, 0, &offset, &length);
+    }
+    write_record("response", job->url, date, response_id, NULL,
+                 "application/http; msgtype=response",
+                 job->reply, job->reply_length, job->spill_path, job->spill_length,
+                 &offset, &length);
+
+    // CDX fields: N b a m s S V g
+    char mime[128];
+    size_t key_size = 3 * strlen(job->url) + 16;   // Escapes triple a byte at most
+    char *key = malloc(key_size);
+    int status = 0;
+    reply_mime(job, mime, sizeof(mime));
+    sscanf(job->reply, "HTTP/%*d.%*d %d", &status);
+    cdx_url_key(job->url, key, key_size);
+    fprintf(cdx_file, "%s %s ", key, cdx_date);
+    put_cdx_url(job->url);
+    fprintf(cdx_file, " %s %d %ld %ld %s\n", mime, status, length, offset, warc_name);
+    free(key);
+}
+
+static void free_job(warc_job_t *job) {
+    if (job->spill_path) {
+        unlink(job->spill_path);
+        free(job->spill_path);
+    }
+    free(job->url);
+    free(job->request);
+    free(job->reply);
+    budget_release(MEM_WRITE, job->reply_size);
+    free(job);
+}
+
+static void *writer_main(void *arg) {
+    while (1) {
+        pthread_mutex_lock(&warc_mutex);
+        while (queue_head == NULL && !closing) {
+            pthread_cond_wait(&warc_ready, &warc_mutex);
+        }
+        warc_job_t *job = queue_head;
+        if (job) {
+            queue_head = job->next;
+            if (queue_head == NULL) {
+                queue_tail = NULL;
+            }
+        }
+        pthread_mutex_unlock(&warc_mutex);
+
+        if (job == NULL) {
+            break;
+        }
+        write_job(job);
+        free_job(job);
+    }
+    return NULL;
+}
+
+int warc_open(const char *prefix, size_t max_size, int gzip) {
+    warc_prefix = strdup(prefix);
+    warc_max_size = max_size;
+    warc_gzip = gzip;
+
+    snprintf(cdx_name, sizeof(cdx_name), "%s.cdx", prefix);
+    cdx_file = fopen(cdx_name, "w");
+    if (cdx_file == NULL) {
+        fprintf(stderr, "Could not open CDX index %s: %s\n", cdx_name, strerror(errno));
+        free(warc_prefix);
+        return -1;
+    }
+    fprintf(cdx_file, " CDX N b a m s S V g\n");
+
+    closing = 0;
+    if (pthread_create(&writer_thread, NULL, writer_main, NULL) != 0) {
+        fprintf(stderr, "Could not start WARC writer thread\n");
+        fclose(cdx_file);
+        free(warc_prefix);
+        return -1;
+    }
+    enabled = 1;
+    return 0;
+}
+
+/*
+ * Queue a finished exchange for the writer thread. The reply buffer,
+ * request and spill file move into the job, so nothing is copied; the
+ * reply's budget moves from MEM_REPLY to MEM_WRITE until it is written.
+ */
+void warc_write_exchange(const char *url, http_reply *reply) {
+    warc_job_t *job = calloc(1, sizeof(warc_job_t));
+
+    job->url = strdup(url);
+    job->fetched = time(NULL);
+    job->request = reply->request;
+    job->reply = reply->reply_buffer;
+    job->reply_length = reply->reply_buffer_length;
+    job->reply_size = reply->reply_buffer_size;
+    job->spill_path = reply->spill_path;
+    job->spill_length = reply->spill_length;
+
+    budget_charge(MEM_WRITE, job->reply_size);
+    budget_release(MEM_REPLY, job->reply_size);
+    reply->request = NULL;
+    reply->reply_buffer = NULL;
+    reply->reply_buffer_size = 0;
+    reply->spill_path = NULL;
+
+    pthread_mutex_lock(&warc_mutex);
+    if (queue_tail) {
+        queue_tail->next = job;
+    } else {
+        queue_head = job;
+    }
+    queue_tail = job;
+    pthread_cond_signal(&warc_ready);
+    pthread_mutex_unlock(&warc_mutex);
+}
+
+static int compare_lines(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/*
+ * Sort the index by key (byte order) once every record is in. Lines
+ * are written in fetch order, so the whole file is read back; the
+ * header line starts with a space and stays first.
+ */
+static void sort_cdx(void) {
+    FILE *in = fopen(cdx_name, "r");
+    if (in == NULL) {
+        fprintf(stderr, "Could not reopen CDX index %s: %s\n", cdx_name, strerror(errno));
+        return;
+    }
+
+    char **lines = NULL;
+    size_t count = 0, cap = 0;
+    char *line = NULL;
+    size_t line_cap = 0;
+    while (getline(&line, &line_cap, in) > 0) {
+        if (count == cap) {
+            cap = cap ? cap * 2 : 1024;
+            lines = realloc(lines, cap * sizeof(char *));
+        }
+        lines[count++] = strdup(line);
+    }
+    free(line);
+    fclose(in);
+
+    qsort(lines, count, sizeof(char *), compare_lines);
+    FILE *out = fopen(cdx_name, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Could not rewrite CDX index %s: %s\n", cdx_name, strerror(errno));
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (out) {
+            fputs(lines[i], out);
+        }
+        free(lines[i]);
+    }
+    free(lines);
+    if (out) {
+        fclose(out);
+    }
+}
+
+// Drain the queue, then close the current WARC file and the index
+void warc_close(void) {
+    if (!enabled) {
+        return;
+    }
+
+    pthread_mutex_lock(&warc_mutex);
+    closing = 1;
+    pthread_cond_signal(&warc_ready);
+    pthread_mutex_unlock(&warc_mutex);
+    pthread_join(writer_thread, NULL);
+
+    if (warc_file) {
+        fclose(warc_file);
+        warc_file = NULL;
+    }
+    fclose(cdx_file);
+    cdx_file = NULL;
+    sort_cdx();
+    free(warc_prefix);
+    warc_prefix = NULL;
+    enabled = 0;
+}
+
+void warc_print_stats(FILE *out) {
+    pthread_mutex_lock(&warc_mutex);
+    if (files_written > 0) {
+        fprintf(out, "WARC output:\t%ld records, %lld bytes in %d files\n",
+                records_written, bytes_written, files_written);
+    }
+    pthread_mutex_unlock(&warc_mutex);
+}
@@ -0,0 +1,28 @@
+#ifndef WARC_H_
+#define WARC_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+/*
+ * WARC output backend. Request/response pairs are handed to a single
+ * writer thread that appends them to rotating PREFIX-NNNNN.warc[.gz]
+ * files, one gzip member per record when compressed, and indexes every
+ * response in PREFIX.cdx. The index is keyed by a canonical SURT form of
+ * the URL and sorted when the archive is closed, so lookups can binary
+ * search it (the same order as "LC_ALL=C sort").
+ */
+
+#define WARC_DEFAULT_MAX_SIZE (1UL << 30)   // Rotate once a file reaches this size
+#define WARC_COPY_CHUNK 65536               // Read size when streaming spilled bodies
+
+struct http_reply;
+
+int warc_open(const char *prefix, size_t max_size, int gzip);
+void warc_write_exchange(const char *url, struct http_reply *reply);
+void cdx_url_key(const char *url, char *out, size_t len);
+void warc_close(void);
+int warc_enabled(void);
+void warc_print_stats(FILE *out);
+
+#endif /* WARC_H_ */
@@ -6,20 +6,49 @@
 #include <netdb.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <ctype.h>
 #include <strings.h>
 #include <pthread.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <getopt.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
 
 
 #include "url.h"
 #include "wgetX.h"
+#include "shard.h"
+#include "budget.h"
+#include "seeds.h"
+#include "warc.h"
+#include "hosts.h"
 
-#define BUFFER_SIZE 8888888
+#define BUFFER_SIZE 65536        // Initial reply buffer, doubled as needed; caps the headers
+#define SPILL_CHUNK_SIZE 65536   // Bounce buffer once a body goes to disk
+#define SPLICE_CHUNK_SIZE 65536  // Bytes moved per splice() into the pipe
 #define MAX_DEPTH 3
 #define THREAD_POOL_SIZE 4
 #define MAX_QUEUE_SIZE 1000
+#define VISITED_INITIAL_BUCKETS 4096   // Power of two, doubled as the set grows
+#define PARKED_POLL_MS 1000             // How often idle workers look at parked hosts
+#define HE_CONNECTION_DELAY_MS 250      // Head start each attempt gets (RFC 8305)
+
+// Timeouts in milliseconds, see usage()
+int connect_timeout_ms = 10000;
+int first_byte_timeout_ms = 30000;
+int idle_timeout_ms = 30000;
+int slow_response_ms = 20000;
+
+// Splice non-HTML bodies straight to disk
+int zero_copy_enabled = 1;
+
+// Spill files are created 0600; saved downloads get the usual mode
+static mode_t download_mode = 0644;
 
 // URL queue structure
 
@@ -28,8 +57,12 @@
 url_queue_t url_queue;
 pthread_mutex_t visited_mutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t active_mutex = PTHREAD_MUTEX_INITIALIZER;
-char **visited_urls = NULL;
-int visited_count = 0;
+visited_node_t **visited_buckets = NULL;
+size_t visited_bucket_count = 0;
+size_t visited_count = 0;
+crawl_stats_t crawl_stats;
+pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+volatile sig_atomic_t stats_requested = 0;
 
 // Function to free URL info structure
 void free_url_info(url_info *info) {
@@ -40,6 +73,13 @@ void free_url_info(url_info *info) {
     }
 }
 
+// Absolute URL of a parsed url_info, malloc'd
+static char *format_url(const url_info *info) {
+    char *url = malloc(strlen(info->protocol) + strlen(info->host) + strlen(info->path) + 8);
+    sprintf(url, "%s://%s/%s", info->protocol, info->host, info->path);
+    return url;
+}
+
 // Find next line in buffer
 char *next_line(char *buff, int len) {
     if (len == 0) {
@@ -56,57 +96,30 @@ char *next_line(char *buff, int len) {
     return NULL;
 }
 
-// Function to rewrite URLs in HTML content
-char* rewrite_html_urls(const char *content, size_t content_len, const char *base_url) {
-    char *result = malloc(content_len * 2);  // Allocate more space for possible expansion
-    char *write_ptr = result;
+/*
+ * Write HTML to 'file' with every href pointed at the local copy. Works
+ * within content_len, so content may be a mapping with no trailing NUL,
+ * and streams the output instead of building a rewritten copy.
+ */
+void write_rewritten_html(FILE *file, const char *content, size_t content_len) {
     const char *read_ptr = content;
     const char *end_ptr = content + content_len;
     
     while (read_ptr < end_ptr) {
-        const char *href = strstr(read_ptr, "href=\"");
-        if (!href || href >= end_ptr) {
+        const char *href = memmem(read_ptr, end_ptr - read_ptr, "href=\"", 6);
+        const char *url_end = href ? memchr(href + 6, '"', end_ptr - href - 6) : NULL;
+        if (!url_end) {
             // Copy remaining content
-            size_t remaining = end_ptr - read_ptr;
-            memcpy(write_ptr, read_ptr, remaining);
-            write_ptr += remaining;
+            fwrite(read_ptr, 1, end_ptr - read_ptr, file);
             break;
         }
         
-        // Copy content up to href
-        size_t prefix_len = href - read_ptr;
-        memcpy(write_ptr, read_ptr, prefix_len);
-        write_ptr += prefix_len;
-        
-        // Copy href="
-        memcpy(write_ptr, "href=\"", 6);
-        write_ptr += 6;
-        
-        // Find URL end
-        const char *url_start = href + 6;
-        const char *url_end = strchr(url_start, '"');
-        if (!url_end || url_end >= end_ptr) break;
-        
-        // Extract and rewrite URL
-        size_t url_len = url_end - url_start;
-        char url[1024];
-        strncpy(url, url_start, url_len);
-        url[url_len] = '\0';
-        
-        // Create local path
-        char local_path[2048];
-        snprintf(local_path, sizeof(local_path), "downloads/%s", url);
-        
-        // Write local path
-        size_t local_len = strlen(local_path);
-        memcpy(write_ptr, local_path, local_len);
-        write_ptr += local_len;
-        
+        // Copy content up to and including href=", then the local path
+        fwrite(read_ptr, 1, href + 6 - read_ptr, file);
+        fputs("downloads/", file);
+        fwrite(href + 6, 1, url_end - href - 6, file);
         read_ptr = url_end;
     }
-    
-    *write_ptr = '\0';
-    return result;
 }
 
 // Create directories recursively
@@ -127,7 +140,7 @@ void create_directories(const char *path) {
 }
 
 // Write data to file
-void write_data(const char *path, const char *data, int len, int is_html) {
+void write_data(const char *path, const char *data, size_t len, int is_html) {
     char full_path[2048];
     snprintf(full_path, sizeof(full_path), "downloads/%s", path);
     
@@ -147,9 +160,7 @@ void write_data(const char *path, const char *data, int len, int is_html) {
     
     if (is_html) {
         // Rewrite URLs in HTML content before saving
-        char *rewritten = rewrite_html_urls(data, len, path);
-        fwrite(rewritten, 1, strlen(rewritten), file);
-        free(rewritten);
+        write_rewritten_html(file, data, len);
     } else {
         fwrite(data, 1, len, file);
     }
@@ -158,6 +169,105 @@ void write_data(const char *path, const char *data, int len, int is_html) {
     fprintf(stderr, "Saved: %s\n", full_path);
 }
 
+/*
+ * Map a spilled body for reading. Returns NULL for an empty or unreadable
+ * file; release with munmap(map, *len).
+ */
+static char *map_spill_file(const char *spill_path, size_t *len) {
+    int fd = open(spill_path, O_RDONLY);
+    struct stat st;
+    char *map = NULL;
+    
+    if (fd < 0) {
+        fprintf(stderr, "Could not open spilled body %s: %s\n", spill_path, strerror(errno));
+        return NULL;
+    }
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            fprintf(stderr, "Could not map spilled body %s: %s\n", spill_path, strerror(errno));
+            map = NULL;
+        } else {
+            *len = st.st_size;
+        }
+    }
+    close(fd);
+    return map;
+}
+
+// Queue the links of an HTML body that was spilled to disk
+void extract_spilled_urls(const char *spill_path, const char *base_url, int depth) {
+    size_t len;
+    char *map = map_spill_file(spill_path, &len);
+    if (map) {
+        extract_urls(map, len, base_url, depth);
+        munmap(map, len);
+    }
+}
+
+/*
+ * Move a body spilled to disk into its place under downloads/. HTML is
+ * rewritten from a mapping of the file rather than renamed, so its links
+ * point at the local copies like those of pages kept in memory.
+ */
+void write_spilled_data(const char *path, const char *spill_path, int is_html) {
+    char full_path[2048];
+    snprintf(full_path, sizeof(full_path), "downloads/%s", path);
+    
+    if (is_html) {
+        size_t len = 0;
+        char *map = map_spill_file(spill_path, &len);
+        write_data(path, map ? map : "", len, 1);
+        if (map) {
+            munmap(map, len);
+        }
+        unlink(spill_path);
+        return;
+    }
+    
+    char *last_slash = strrchr(full_path, '/');
+    if (last_slash) {
+        *last_slash = '\0';
+        create_directories(full_path);
+        *last_slash = '/';
+    }
+    
+    chmod(spill_path, download_mode);
+    if (rename(spill_path, full_path) != 0) {
+        fprintf(stderr, "Could not move %s to %s: %s\n", spill_path, full_path, strerror(errno));
+        return;
+    }
+    fprintf(stderr, "Saved: %s\n", full_path);
+}
+
+static void stats_add(long *counter, long n) {
+    pthread_mutex_lock(&stats_mutex);
+    *counter += n;
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+void print_stats(void) {
+    pthread_mutex_lock(&stats_mutex);
+    fprintf(stderr, "Pages fetched:\t%ld (%ld failed)\n", crawl_stats.pages_fetched, crawl_stats.pages_failed);
+    fprintf(stderr, "Bytes received:\t%ld (%ld bodies spilled to disk)\n",
+            crawl_stats.bytes_received, crawl_stats.bodies_spilled);
+    fprintf(stderr, "Zero-copy:\t%ld bytes in %ld bodies spliced to disk, %ld fell back to recv()\n",
+            crawl_stats.bytes_zero_copy, crawl_stats.bodies_zero_copy, crawl_stats.splice_fallbacks);
+    pthread_mutex_unlock(&stats_mutex);
+    budget_print_stats(stderr);
+    hosts_print_stats(stderr);
+    warc_print_stats(stderr);
+}
+
+static void request_stats(int sig) {
+    stats_requested = 1;
+}
+
+// Bytes a queued item holds beyond its preallocated slot
+static size_t queue_item_bytes(const queue_item_t *item) {
+    return strlen(item->url) + 1 + (item->parent_url ? strlen(item->parent_url) + 1 : 0);
+}
+
 // 改进的线程池和队列操作
 void init_url_queue(void) {
     url_queue.capacity = MAX_QUEUE_SIZE;
@@ -165,8 +275,11 @@ void init_url_queue(void) {
     url_queue.size = 0;
     url_queue.front = 0;
     url_queue.rear = -1;
+    url_queue.overflow_head = url_queue.overflow_tail = NULL;
     url_queue.active_threads = 0;
     url_queue.should_shutdown = 0;
+    url_queue.remote_received = 0;
+    url_queue.seeding = 0;
     pthread_mutex_init(&url_queue.mutex, NULL);
     pthread_cond_init(&url_queue.not_empty, NULL);
     pthread_cond_init(&url_queue.not_full, NULL);
@@ -175,44 +288,173 @@ void init_url_queue(void) {
 void cleanup_url_queue(void) {
     for (int i = 0; i < url_queue.size; i++) {
         int idx = (url_queue.front + i) % url_queue.capacity;
+        budget_release(MEM_QUEUE, queue_item_bytes(&url_queue.items[idx]));
         free(url_queue.items[idx].url);
         free(url_queue.items[idx].parent_url);
     }
+    while (url_queue.overflow_head) {
+        queue_node_t *node = url_queue.overflow_head;
+        url_queue.overflow_head = node->next;
+        budget_release(MEM_QUEUE, queue_item_bytes(&node->item) + sizeof(queue_node_t));
+        free(node->item.url);
+        free(node->item.parent_url);
+        free(node);
+    }
+    url_queue.overflow_tail = NULL;
     free(url_queue.items);
     pthread_mutex_destroy(&url_queue.mutex);
     pthread_cond_destroy(&url_queue.not_empty);
     pthread_cond_destroy(&url_queue.not_full);
 }
 
+// Must be called with url_queue.mutex held and room in the queue
+static void push_url_locked(const char *url, const char *parent_url, int depth) {
+    url_queue.rear = (url_queue.rear + 1) % url_queue.capacity;
+    url_queue.items[url_queue.rear].url = strdup(url);
+    url_queue.items[url_queue.rear].parent_url = parent_url ? strdup(parent_url) : NULL;
+    url_queue.items[url_queue.rear].depth = depth;
+    url_queue.size++;
+    budget_charge(MEM_QUEUE, queue_item_bytes(&url_queue.items[url_queue.rear]));
+    
+    pthread_cond_signal(&url_queue.not_empty);
+}
+
+/*
+ * Queue a link found on a page. Never blocks: the worker calling this
+ * still holds the page's reply, and waiting on a full queue while other
+ * workers wait on the memory budget would deadlock. Links beyond the
+ * queue's capacity go to an overflow list charged to MEM_QUEUE.
+ */
 int enqueue_url(const char *url, const char *parent_url, int depth) {
     pthread_mutex_lock(&url_queue.mutex);
     
-    while (url_queue.size >= url_queue.capacity && !url_queue.should_shutdown) {
-        pthread_cond_wait(&url_queue.not_full, &url_queue.mutex);
-    }
-    
     if (url_queue.should_shutdown) {
         pthread_mutex_unlock(&url_queue.mutex);
         return -1;
     }
     
+    if (url_queue.size < url_queue.capacity) {
+        push_url_locked(url, parent_url, depth);
+    } else {
+        queue_node_t *node = malloc(sizeof(queue_node_t));
+        node->next = NULL;
+        node->item.url = strdup(url);
+        node->item.parent_url = parent_url ? strdup(parent_url) : NULL;
+        node->item.depth = depth;
+        budget_charge(MEM_QUEUE, queue_item_bytes(&node->item) + sizeof(queue_node_t));
+        if (url_queue.overflow_tail) {
+            url_queue.overflow_tail->next = node;
+        } else {
+            url_queue.overflow_head = node;
+        }
+        url_queue.overflow_tail = node;
+    }
+    pthread_mutex_unlock(&url_queue.mutex);
+    return 0;
+}
+
+// Move the oldest overflowed link into the slot dequeue_url() just freed
+static void refill_from_overflow_locked(void) {
+    queue_node_t *node = url_queue.overflow_head;
+    if (node == NULL || url_queue.size >= url_queue.capacity) {
+        return;
+    }
+    
+    url_queue.overflow_head = node->next;
+    if (url_queue.overflow_head == NULL) {
+        url_queue.overflow_tail = NULL;
+    }
     url_queue.rear = (url_queue.rear + 1) % url_queue.capacity;
-    url_queue.items[url_queue.rear].url = strdup(url);
-    url_queue.items[url_queue.rear].parent_url = parent_url ? strdup(parent_url) : NULL;
-    url_queue.items[url_queue.rear].depth = depth;
+    url_queue.items[url_queue.rear] = node->item;
     url_queue.size++;
+    budget_release(MEM_QUEUE, sizeof(queue_node_t));
+    free(node);
+}
+
+/*
+ * Queue a seed from the seed list. Seeds only fill the queue up to half
+ * its capacity so workers always have room for the links they discover.
+ */
+int enqueue_seed_url(const char *url) {
+    if (is_visited(url)) {
+        return 0;
+    }
     
-    pthread_cond_signal(&url_queue.not_empty);
+    pthread_mutex_lock(&url_queue.mutex);
+    while (url_queue.size >= url_queue.capacity / 2 && !url_queue.should_shutdown) {
+        pthread_cond_wait(&url_queue.not_full, &url_queue.mutex);
+    }
+    
+    if (url_queue.should_shutdown) {
+        pthread_mutex_unlock(&url_queue.mutex);
+        return -1;
+    }
+    
+    push_url_locked(url, NULL, 0);
     pthread_mutex_unlock(&url_queue.mutex);
     return 0;
 }
 
+// Accept a link routed to this shard by the coordinator, same headroom as seeds
+void accept_remote_url(const char *url, int depth) {
+    int fresh = !is_visited(url);
+    
+    pthread_mutex_lock(&url_queue.mutex);
+    while (fresh && url_queue.size >= url_queue.capacity / 2 && !url_queue.should_shutdown) {
+        pthread_cond_wait(&url_queue.not_full, &url_queue.mutex);
+    }
+    if (fresh && !url_queue.should_shutdown) {
+        push_url_locked(url, NULL, depth);
+    }
+    // Counted together with the push so idle reports stay consistent
+    url_queue.remote_received++;
+    pthread_mutex_unlock(&url_queue.mutex);
+}
+
+void shutdown_url_queue(void) {
+    pthread_mutex_lock(&url_queue.mutex);
+    url_queue.should_shutdown = 1;
+    pthread_cond_broadcast(&url_queue.not_empty);
+    pthread_cond_broadcast(&url_queue.not_full);
+    pthread_mutex_unlock(&url_queue.mutex);
+}
+
+// Put URLs of hosts that became fetchable back in the queue, with headroom
+static void requeue_parked_locked(void) {
+    int room = url_queue.capacity / 2 - url_queue.size;
+    if (room <= 0 || host_parked_count() == 0) {
+        return;
+    }
+    
+    queue_item_t *items = malloc(room * sizeof(queue_item_t));
+    int count = host_take_parked(items, room);
+    for (int i = 0; i < count; i++) {
+        push_url_locked(items[i].url, items[i].parent_url, items[i].depth);
+        free(items[i].url);
+        free(items[i].parent_url);
+    }
+    free(items);
+}
+
 int dequeue_url(queue_item_t *item) {
     pthread_mutex_lock(&url_queue.mutex);
     
-    while (url_queue.size == 0 && !url_queue.should_shutdown) {
-        // Wait for new items or shutdown signal
-        pthread_cond_wait(&url_queue.not_empty, &url_queue.mutex);
+    while (1) {
+        requeue_parked_locked();
+        if (url_queue.size > 0 || url_queue.should_shutdown) {
+            break;
+        }
+        
+        if (host_parked_count() > 0) {
+            // Wake up in time to probe hosts whose circuit is open
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += PARKED_POLL_MS / 1000;
+            pthread_cond_timedwait(&url_queue.not_empty, &url_queue.mutex, &deadline);
+        } else {
+            // Wait for new items or shutdown signal
+            pthread_cond_wait(&url_queue.not_empty, &url_queue.mutex);
+        }
     }
     
     if (url_queue.size == 0 && url_queue.should_shutdown) {
@@ -222,58 +464,169 @@ int dequeue_url(queue_item_t *item) {
     
     // Copy item data
     *item = url_queue.items[url_queue.front];
+    budget_release(MEM_QUEUE, queue_item_bytes(item));
     url_queue.front = (url_queue.front + 1) % url_queue.capacity;
     url_queue.size--;
+    url_queue.active_threads++;
+    // Keeps the invariant that the overflow list is empty unless the queue is full
+    refill_from_overflow_locked();
     
     pthread_cond_signal(&url_queue.not_full);
     pthread_mutex_unlock(&url_queue.mutex);
     return 0;
 }
+
+// Mark the item taken by dequeue_url() as done
+void finish_url(void) {
+    pthread_mutex_lock(&url_queue.mutex);
+    url_queue.active_threads--;
+    int idle = (url_queue.active_threads == 0 && url_queue.size == 0 && host_parked_count() == 0);
+    if (idle && shard_count == 0 && !url_queue.seeding) {
+        // Signal shutdown when all tasks are complete
+        url_queue.should_shutdown = 1;
+        pthread_cond_broadcast(&url_queue.not_empty);
+    }
+    long received = url_queue.remote_received;
+    pthread_mutex_unlock(&url_queue.mutex);
+    
+    if (stats_requested) {
+        stats_requested = 0;
+        print_stats();
+    }
+    
+    // A shard only stops when the coordinator says so
+    if (shard_count > 0) {
+        if (idle) {
+            shard_report_idle(received);
+        } else {
+            shard_flush_if_stale();
+        }
+    }
+}
+
+// In shard mode, tell the coordinator when the local queue has drained
+void report_if_idle(void) {
+    pthread_mutex_lock(&url_queue.mutex);
+    int idle = (url_queue.active_threads == 0 && url_queue.size == 0 && host_parked_count() == 0);
+    long received = url_queue.remote_received;
+    pthread_mutex_unlock(&url_queue.mutex);
+    
+    if (idle) {
+        shard_report_idle(received);
+    }
+}
+// djb2; kept apart from the shard hash so bucket use is not skewed per shard
+static size_t hash_url(const char *url) {
+    size_t hash = 5381;
+    while (*url) {
+        hash = hash * 33 + (unsigned char)*url++;
+    }
+    return hash;
+}
+
+// Must be called with visited_mutex held
+static void grow_visited_locked(void) {
+    size_t new_count = visited_bucket_count ? visited_bucket_count * 2 : VISITED_INITIAL_BUCKETS;
+    visited_node_t **buckets = calloc(new_count, sizeof(visited_node_t *));
+    if (buckets == NULL) {
+        return;     // Keep the old table, chains just get longer
+    }
+    
+    for (size_t i = 0; i < visited_bucket_count; i++) {
+        visited_node_t *node = visited_buckets[i];
+        while (node) {
+            visited_node_t *next = node->next;
+            size_t idx = hash_url(node->url) & (new_count - 1);
+            node->next = buckets[idx];
+            buckets[idx] = node;
+            node = next;
+        }
+    }
+    free(visited_buckets);
+    visited_buckets = buckets;
+    visited_bucket_count = new_count;
+}
+
 // Check if URL has been visited
 int is_visited(const char *url) {
     pthread_mutex_lock(&visited_mutex);
-    for (int i = 0; i < visited_count; i++) {
-        if (strcmp(visited_urls[i], url) == 0) {
+    if (visited_count >= visited_bucket_count) {
+        grow_visited_locked();
+    }
+    
+    size_t idx = hash_url(url) & (visited_bucket_count - 1);
+    for (visited_node_t *node = visited_buckets[idx]; node; node = node->next) {
+        if (strcmp(node->url, url) == 0) {
             pthread_mutex_unlock(&visited_mutex);
             return 1;
         }
     }
     
-    visited_urls = realloc(visited_urls, (visited_count + 1) * sizeof(char*));
-    visited_urls[visited_count++] = strdup(url);
+    size_t len = strlen(url);
+    visited_node_t *node = malloc(sizeof(visited_node_t) + len + 1);
+    memcpy(node->url, url, len + 1);
+    node->next = visited_buckets[idx];
+    visited_buckets[idx] = node;
+    visited_count++;
     pthread_mutex_unlock(&visited_mutex);
     return 0;
 }
+
+void cleanup_visited(void) {
+    for (size_t i = 0; i < visited_bucket_count; i++) {
+        visited_node_t *node = visited_buckets[i];
+        while (node) {
+            visited_node_t *next = node->next;
+            free(node);
+            node = next;
+        }
+    }
+    free(visited_buckets);
+    visited_buckets = NULL;
+    visited_bucket_count = 0;
+    visited_count = 0;
+}
+
 void extract_urls(const char *html, size_t html_len, const char *base_url, int depth) {
     const char *ptr = html;
     const char *end = html + html_len;
     
-    while ((ptr = strstr(ptr, "href=\"")) && ptr < end) {
+    // Bounded by html_len: html may be a mapped spill file without a NUL
+    while ((ptr = memmem(ptr, end - ptr, "href=\"", 6)) != NULL) {
         ptr += 6;
-        const char *quote_end = strchr(ptr, '"');
-        if (!quote_end || quote_end >= end) break;
+        const char *quote_end = memchr(ptr, '"', end - ptr);
+        if (!quote_end) break;
         
         size_t url_len = quote_end - ptr;
         char *url = malloc(url_len + 1);
-        strncpy(url, ptr, url_len);
+        memcpy(url, ptr, url_len);
         url[url_len] = '\0';
         
         // Handle relative URLs
         if (url[0] == '/') {
-            url_info base_info;
-            if (parse_url((char*)base_url, &base_info) == 0) {
+            url_info base_info = {0};
+            // parse_url() chops up its argument, so work on a copy
+            char *base_copy = strdup(base_url);
+            if (parse_url(base_copy, &base_info) == 0 && base_info.host) {
                 char *absolute_url = malloc(strlen(base_info.host) + strlen(url) + 10);
                 sprintf(absolute_url, "%s://%s%s", base_info.protocol, base_info.host, url);
                 free(url);
                 url = absolute_url;
-                free_url_info(&base_info);
             }
+            free_url_info(&base_info);
+            free(base_copy);
         }
         
         // Process all URLs that haven't been visited yet
         if (!is_visited(url) && (strncmp(url, "http://", 7) == 0 || strncmp(url, "https://", 8) == 0)) {
-            fprintf(stderr, "Found new URL: %s (depth: %d)\n", url, depth + 1);
-            enqueue_url(url, base_url, depth + 1);
+            if (shard_owns_url(url)) {
+                fprintf(stderr, "Found new URL: %s (depth: %d)\n", url, depth + 1);
+                enqueue_url(url, base_url, depth + 1);
+            } else {
+                fprintf(stderr, "Forwarding URL to shard %d: %s (depth: %d)\n",
+                        shard_owner_of_url(url), url, depth + 1);
+                shard_forward_url(url, depth + 1);
+            }
         } else {
             fprintf(stderr, "URL already visited: %s\n", url);
         }
@@ -284,10 +637,6 @@ void extract_urls(const char *html, size_t html_len, const char *base_url, int d
 }
 // 修改 worker_thread 函数来改进线程池行为
 void *worker_thread(void *arg) {
-    pthread_mutex_lock(&url_queue.mutex);
-    url_queue.active_threads++;
-    pthread_mutex_unlock(&url_queue.mutex);
-    
     while (1) {
         queue_item_t item;
         if (dequeue_url(&item) != 0) {
@@ -299,16 +648,53 @@ void *worker_thread(void *arg) {
                     (void*)pthread_self(), MAX_DEPTH, item.url);
             free(item.url);
             free(item.parent_url);
+            finish_url();
             continue;
         }
         
         fprintf(stderr, "Thread %p processing URL: %s (depth: %d)\n", 
                 (void*)pthread_self(), item.url, item.depth);
         
-        url_info info;
-        if (parse_url(item.url, &info) == 0) {
+        url_info info = {0};
+        char *url_copy = strdup(item.url);
+        int parsed = (parse_url(url_copy, &info) == 0);
+        int admitted = parsed ? host_admit_or_park(info.host, &item) : 1;
+        if (admitted == 0) {
+            // Circuit open: the item now waits with its host
+            fprintf(stderr, "Thread %p: circuit open for %s, parking %s\n", 
+                    (void*)pthread_self(), info.host, item.url);
+            free_url_info(&info);
+            free(url_copy);
+            finish_url();
+            continue;
+        }
+        if (admitted < 0) {
+            fprintf(stderr, "Thread %p: host %s given up, dropping %s\n", 
+                    (void*)pthread_self(), info.host, item.url);
+            stats_add(&crawl_stats.pages_failed, 1);
+            free_url_info(&info);
+            free(url_copy);
+            free(item.url);
+            free(item.parent_url);
+            finish_url();
+            continue;
+        }
+        
+        if (parsed) {
+            // info follows redirects, health belongs to the host we asked
+            char *host = strdup(info.host);
             http_reply reply = {0};
             if (download_page(&info, &reply, 0) == 0) {
+                int status = 0;
+                sscanf(reply.reply_buffer, "HTTP/%*d.%*d %d", &status);
+                // Time to the headers only: large bodies are not a slow host
+                if (reply.header_ms > slow_response_ms) {
+                    fprintf(stderr, "Thread %p: slow response from %s (%ld ms)\n", 
+                            (void*)pthread_self(), host, reply.header_ms);
+                }
+                int dropped = host_report(host, status < 500 && reply.header_ms <= slow_response_ms);
+                stats_add(&crawl_stats.pages_failed, dropped);
+                
                 char *response = read_http_reply(&reply);
                 if (response) {
                     // Check content type
@@ -319,7 +705,7 @@ void *worker_thread(void *arg) {
                     }
                     
                     // Create local path and save file
-                    char *filename = malloc(strlen(info.host) + strlen(info.path) + 2);
+                    char *filename = malloc(strlen(info.host) + strlen(info.path) + 12);
                     if (strlen(info.path) == 0) {
                         sprintf(filename, "%s/index.html", info.host);
                     } else {
@@ -327,37 +713,66 @@ void *worker_thread(void *arg) {
                     }
                     
                     size_t content_len = reply.reply_buffer_length - (response - reply.reply_buffer);
-                    write_data(filename, response, content_len, is_html);
+                    stats_add(&crawl_stats.pages_fetched, 1);
+                    if (reply.spill_path) {
+                        if (reply.zero_copy > 0) {
+                            stats_add(&crawl_stats.bodies_zero_copy, 1);
+                            stats_add(&crawl_stats.bytes_zero_copy, reply.zero_copy_bytes);
+                        } else if (reply.zero_copy < 0) {
+                            stats_add(&crawl_stats.splice_fallbacks, 1);
+                        } else {
+                            stats_add(&crawl_stats.bodies_spilled, 1);
+                        }
+                        stats_add(&crawl_stats.bytes_received, reply.spill_length);
+                    } else {
+                        stats_add(&crawl_stats.bytes_received, content_len);
+                    }
                     
-                    // Extract and queue new URLs if HTML
-                    if (is_html) {
+                    // Extract and queue new URLs if HTML, from disk if it was spilled
+                    if (is_html && reply.spill_path) {
+                        fprintf(stderr, "Thread %p: Extracting URLs from spilled %s\n", 
+                                (void*)pthread_self(), item.url);
+                        extract_spilled_urls(reply.spill_path, item.url, item.depth);
+                    } else if (is_html && content_len > 0) {
                         fprintf(stderr, "Thread %p: Extracting URLs from %s\n", 
                                 (void*)pthread_self(), item.url);
                         extract_urls(response, content_len, item.url, item.depth);
                     }
                     
+                    if (warc_enabled()) {
+                        // Record under the final URL; download_page() archived the hops
+                        char *target = format_url(&info);
+                        warc_write_exchange(target, &reply);
+                        free(target);
+                    } else if (reply.spill_path) {
+                        // Spliced, or too big for the memory budget
+                        write_spilled_data(filename, reply.spill_path, is_html);
+                        free(reply.spill_path);
+                        reply.spill_path = NULL;
+                    } else {
+                        write_data(filename, response, content_len, is_html);
+                    }
+                    
                     free(filename);
                 }
-                free(reply.reply_buffer);
+                free_http_reply(&reply);
             } else {
                 fprintf(stderr, "Thread %p: Failed to download %s\n", 
                         (void*)pthread_self(), item.url);
+                stats_add(&crawl_stats.pages_failed, 1 + host_report(host, 0));
+                // download_page() frees on error, but never leave it to chance
+                free_http_reply(&reply);
             }
-            free_url_info(&info);
+            free(host);
         }
+        free_url_info(&info);
+        free(url_copy);
         
         free(item.url);
         free(item.parent_url);
         
         // Update active tasks count
-        pthread_mutex_lock(&url_queue.mutex);
-        url_queue.active_threads--;
-        if (url_queue.active_threads == 0 && url_queue.size == 0) {
-            // Signal shutdown when all tasks are complete
-            url_queue.should_shutdown = 1;
-            pthread_cond_broadcast(&url_queue.not_empty);
-        }
-        pthread_mutex_unlock(&url_queue.mutex);
+        finish_url();
     }
     
     return NULL;
@@ -404,10 +819,250 @@ char *read_http_reply(struct http_reply *reply) {
 
     return headers_end + 4;
 }
+// Release a reply's buffer, its budget and any leftover spill file
+void free_http_reply(http_reply *reply) {
+    if (reply->reply_buffer) {
+        free(reply->reply_buffer);
+        budget_release(MEM_REPLY, reply->reply_buffer_size);
+    }
+    if (reply->spill_path) {
+        unlink(reply->spill_path);
+        free(reply->spill_path);
+    }
+    free(reply->request);
+    memset(reply, 0, sizeof(*reply));
+}
+
+/*
+ * Move the body received so far into a temporary file under downloads/
+ * and keep only the headers in memory. Returns the open file descriptor.
+ */
+static int spill_reply_body(http_reply *reply, int total_bytes, int headers_len) {
+    char spill_template[] = "downloads/.spill-XXXXXX";
+    int fd = mkstemp(spill_template);
+    if (fd < 0) {
+        fprintf(stderr, "Could not create spill file: %s\n", strerror(errno));
+        return -1;
+    }
+
+    int body_len = total_bytes - headers_len;
+    if (write(fd, reply->reply_buffer + headers_len, body_len) != body_len) {
+        fprintf(stderr, "Could not write spill file: %s\n", strerror(errno));
+        close(fd);
+        unlink(spill_template);
+        return -1;
+    }
+
+    reply->spill_path = strdup(spill_template);
+    reply->spill_length = body_len;
+    return fd;
+}
+
+/*
+ * Happy Eyeballs: start a non-blocking connect to each address in turn,
+ * HE_CONNECTION_DELAY_MS apart or as soon as the previous attempt fails,
+ * and keep the first one to complete. Returns a blocking socket, or -1
+ * with errno set once every address failed or timeout_ms passed.
+ */
+static int happy_eyeballs_connect(const char *host, struct addrinfo *res, int timeout_ms) {
+    struct addrinfo *addrs[HE_MAX_ATTEMPTS];
+    struct pollfd pfds[HE_MAX_ATTEMPTS];
+    int count = order_addresses(res, host_preferred_family(host), addrs, HE_MAX_ATTEMPTS);
+    int started = 0, in_flight = 0, winner = -1;
+    int last_error = ETIMEDOUT;
+    long deadline = now_ms() + timeout_ms;
+    long next_start = 0;
+    
+    while (winner < 0) {
+        long now = now_ms();
+        if (now >= deadline) {
+            last_error = ETIMEDOUT;
+            break;
+        }
+        
+        if (started < count && (in_flight == 0 || now >= next_start)) {
+            struct addrinfo *ai = addrs[started];
+            int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            pfds[started].fd = -1;
+            pfds[started].events = POLLOUT;
+            pfds[started].revents = 0;
+            if (fd >= 0) {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0 || errno == EINPROGRESS) {
+                    pfds[started].fd = fd;
+                    in_flight++;
+                } else {
+                    last_error = errno;
+                    close(fd);
+                }
+            } else {
+                last_error = errno;
+            }
+            // An attempt that failed outright lets the next one start at once
+            next_start = pfds[started].fd >= 0 ? now + HE_CONNECTION_DELAY_MS : now;
+            started++;
+            continue;
+        }
+        if (in_flight == 0) {
+            break;
+        }
+        
+        long wait = deadline - now;
+        if (started < count && next_start - now < wait) {
+            wait = next_start - now;
+        }
+        if (poll(pfds, started, wait) < 0 && errno != EINTR) {
+            last_error = errno;
+            break;
+        }
+        
+        for (int i = 0; i < started; i++) {
+            if (pfds[i].fd < 0 || pfds[i].revents == 0) {
+                continue;
+            }
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(pfds[i].fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err == 0) {
+                winner = i;
+                break;
+            }
+            // A failed attempt lets the next address start right away
+            last_error = err;
+            close(pfds[i].fd);
+            pfds[i].fd = -1;
+            in_flight--;
+            next_start = now;
+        }
+    }
+    
+    for (int i = 0; i < started; i++) {
+        if (i != winner && pfds[i].fd >= 0) {
+            close(pfds[i].fd);
+        }
+    }
+    if (winner < 0) {
+        errno = last_error;
+        return -1;
+    }
+    
+    int fd = pfds[winner].fd;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    host_remember_family(host, addrs[winner]->ai_family);
+    if (winner > 0) {
+        fprintf(stderr, "Connected to %s on attempt %d (%s)\n", host, winner + 1,
+                addrs[winner]->ai_family == AF_INET6 ? "IPv6" : "IPv4");
+    }
+    return fd;
+}
+
+// Wait for data on a socket, -1 with ETIMEDOUT after timeout_ms
+static int wait_readable(int sockfd, int timeout_ms) {
+    struct pollfd pfd = { .fd = sockfd, .events = POLLIN };
+    int ready;
+    do {
+        ready = poll(&pfd, 1, timeout_ms);
+    } while (ready < 0 && errno == EINTR);
+    
+    if (ready == 0) {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+    return ready < 0 ? -1 : 0;
+}
+
+// Bodies we never look at: successful replies that are not HTML
+static int is_zero_copy_candidate(char *headers, int headers_len) {
+    int status = 0;
+    sscanf(headers, "HTTP/%*d.%*d %d", &status);
+    if (status < 200 || status >= 300) {
+        return 0;
+    }
+    
+    // Same test as the worker's, limited to the headers
+    char saved = headers[headers_len];
+    headers[headers_len] = '\0';
+    char *content_type = strcasestr(headers, "Content-Type:");
+    int is_html = content_type && strcasestr(content_type, "text/html") != NULL;
+    headers[headers_len] = saved;
+    return !is_html;
+}
+
+/*
+ * Move the rest of a body from the socket into fd through a pipe with
+ * splice(), without copying it through user space. Returns the bytes
+ * moved once the server closes the connection, or -1 on error; then
+ * *unsupported tells whether splice() refused before moving anything,
+ * in which case the caller can still read the body normally.
+ */
+static long splice_body(int sockfd, int fd, const char *host, int *unsupported) {
+    int pipefd[2];
+    long moved = 0;
+    
+    *unsupported = 0;
+    if (pipe(pipefd) < 0) {
+        *unsupported = 1;
+        return -1;
+    }
+    
+    while (1) {
+        if (wait_readable(sockfd, idle_timeout_ms) < 0) {
+            fprintf(stderr, "Timed out waiting for %s after %ld spliced bytes: %s\n",
+                    host, moved, strerror(errno));
+            moved = -1;
+            break;
+        }
+        
+        ssize_t n = splice(sockfd, NULL, pipefd[1], NULL, SPLICE_CHUNK_SIZE, SPLICE_F_MOVE);
+        if (n == 0) {
+            break;
+        }
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            *unsupported = (moved == 0 && (errno == EINVAL || errno == ENOSYS));
+            moved = -1;
+            break;
+        }
+        
+        while (n > 0) {
+            ssize_t out = splice(pipefd[0], NULL, fd, NULL, n, SPLICE_F_MOVE);
+            if (out < 0 && errno == EINTR) {
+                continue;
+            }
+            if (out <= 0) {
+                // The pipe still holds data, so no clean fallback from here
+                fprintf(stderr, "Could not splice body to file: %s\n", strerror(errno));
+                close(pipefd[0]);
+                close(pipefd[1]);
+                return -1;
+            }
+            n -= out;
+            moved += out;
+        }
+    }
+    
+    close(pipefd[0]);
+    close(pipefd[1]);
+    return moved;
+}
+
 int download_page(url_info *info, http_reply *reply, int redirect_count) {
     struct addrinfo hints, *res;
     int sockfd;
 
+    // New fetches stall here while the memory budget is used up
+    budget_reserve(MEM_REPLY, BUFFER_SIZE, 1);
+    reply->reply_buffer_size = BUFFER_SIZE;
+    reply->reply_buffer = malloc(BUFFER_SIZE);
+    if (reply->reply_buffer == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        budget_release(MEM_REPLY, BUFFER_SIZE);
+        free_http_reply(reply);
+        return -1;
+    }
+
     memset(&hints, 0, sizeof hints);
     hints.ai_family = AF_UNSPEC;
     hints.ai_socktype = SOCK_STREAM;
@@ -418,20 +1073,17 @@ int download_page(url_info *info, http_reply *reply, int redirect_count) {
     int status = getaddrinfo(info->host, port_str, &hints, &res);
     if (status != 0) {
         fprintf(stderr, "getaddrinfo error: %s\n", gai_strerror(status));
+        free_http_reply(reply);
         return -1;
     }
 
-    sockfd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    // Budget waits and DNS are not the server's fault, so time from here
+    long started = now_ms();
+    sockfd = happy_eyeballs_connect(info->host, res, connect_timeout_ms);
     if (sockfd < 0) {
-        fprintf(stderr, "Could not create socket: %s\n", strerror(errno));
-        freeaddrinfo(res);
-        return -1;
-    }
-
-    if (connect(sockfd, res->ai_addr, res->ai_addrlen) < 0) {
         fprintf(stderr, "Could not connect to server: %s\n", strerror(errno));
-        close(sockfd);
         freeaddrinfo(res);
+        free_http_reply(reply);
         return -1;
     }
 
@@ -440,6 +1092,7 @@ int download_page(url_info *info, http_reply *reply, int redirect_count) {
     char *request = http_get_request(info);
     if (request == NULL) {
         close(sockfd);
+        free_http_reply(reply);
         return -1;
     }
 
@@ -447,48 +1100,140 @@ int download_page(url_info *info, http_reply *reply, int redirect_count) {
         fprintf(stderr, "Could not send request: %s\n", strerror(errno));
         free(request);
         close(sockfd);
+        free_http_reply(reply);
         return -1;
     }
 
-    free(request);
-
-    reply->reply_buffer = malloc(BUFFER_SIZE);
-    if (reply->reply_buffer == NULL) {
-        fprintf(stderr, "Memory allocation error\n");
-        close(sockfd);
-        return -1;
-    }
-
+    reply->request = request;
     reply->reply_buffer_length = 0;
     int total_bytes = 0;
+    int headers_len = 0;    // Length including the blank line, once seen
+    int spill_fd = -1;
     int bytes_received;
+    char spill_chunk[SPILL_CHUNK_SIZE];
 
-    while ((bytes_received = recv(sockfd, reply->reply_buffer + total_bytes, 
-                                BUFFER_SIZE - total_bytes, 0)) > 0) {
-        total_bytes += bytes_received;
-        if (total_bytes >= BUFFER_SIZE) {
-            char *temp = realloc(reply->reply_buffer, total_bytes + BUFFER_SIZE);
+    while (1) {
+        // Nothing at all yet is the first-byte timeout, a stall later the idle one
+        if (wait_readable(sockfd, total_bytes == 0 ? first_byte_timeout_ms : idle_timeout_ms) < 0) {
+            fprintf(stderr, "Timed out waiting for %s after %d bytes: %s\n",
+                    info->host, total_bytes, strerror(errno));
+            if (spill_fd >= 0) {
+                close(spill_fd);
+            }
+            close(sockfd);
+            free_http_reply(reply);
+            return -1;
+        }
+        
+        if (spill_fd >= 0) {
+            bytes_received = recv(sockfd, spill_chunk, sizeof(spill_chunk), 0);
+            if (bytes_received <= 0) {
+                break;
+            }
+            if (write(spill_fd, spill_chunk, bytes_received) != bytes_received) {
+                fprintf(stderr, "Could not write spill file: %s\n", strerror(errno));
+                close(spill_fd);
+                close(sockfd);
+                free_http_reply(reply);
+                return -1;
+            }
+            reply->spill_length += bytes_received;
+            continue;
+        }
+
+        // Keep one byte free for the terminating NUL
+        if (total_bytes + 1 >= reply->reply_buffer_size) {
+            size_t extra = reply->reply_buffer_size;
+            if (headers_len > 0 && budget_reserve(MEM_REPLY, extra, 0) != 0) {
+                fprintf(stderr, "Memory budget exhausted, spilling body to disk\n");
+                spill_fd = spill_reply_body(reply, total_bytes, headers_len);
+                if (spill_fd < 0) {
+                    close(sockfd);
+                    free_http_reply(reply);
+                    return -1;
+                }
+                total_bytes = headers_len;
+                continue;
+            }
+            if (headers_len == 0) {
+                // The first buffer caps the headers, junk without an end is not kept
+                fprintf(stderr, "Reply headers from %s exceed %d bytes\n", info->host, BUFFER_SIZE - 1);
+                close(sockfd);
+                free_http_reply(reply);
+                return -1;
+            }
+            char *temp = realloc(reply->reply_buffer, reply->reply_buffer_size + extra);
             if (temp == NULL) {
                 fprintf(stderr, "Memory allocation error\n");
-                free(reply->reply_buffer);
+                budget_release(MEM_REPLY, extra);
                 close(sockfd);
+                free_http_reply(reply);
                 return -1;
             }
             reply->reply_buffer = temp;
+            reply->reply_buffer_size += extra;
+        }
+
+        bytes_received = recv(sockfd, reply->reply_buffer + total_bytes,
+                              reply->reply_buffer_size - total_bytes - 1, 0);
+        if (bytes_received <= 0) {
+            break;
+        }
+        total_bytes += bytes_received;
+
+        if (headers_len == 0) {
+            char *end = memmem(reply->reply_buffer, total_bytes, "\r\n\r\n", 4);
+            if (end) {
+                headers_len = end - reply->reply_buffer + 4;
+                reply->header_ms = now_ms() - started;
+                reply->reply_buffer[total_bytes] = '\0';
+                
+                // Fast path: the body goes straight from the socket to its file
+                if (zero_copy_enabled && is_zero_copy_candidate(reply->reply_buffer, headers_len)) {
+                    spill_fd = spill_reply_body(reply, total_bytes, headers_len);
+                    if (spill_fd >= 0) {
+                        int unsupported;
+                        total_bytes = headers_len;
+                        long moved = splice_body(sockfd, spill_fd, info->host, &unsupported);
+                        if (moved >= 0) {
+                            reply->spill_length += moved;
+                            reply->zero_copy_bytes = moved;
+                            reply->zero_copy = 1;
+                            break;
+                        }
+                        if (!unsupported) {
+                            close(spill_fd);
+                            close(sockfd);
+                            free_http_reply(reply);
+                            return -1;
+                        }
+                        // Keep going with recv() into the same file
+                        reply->zero_copy = -1;
+                    }
+                }
+            }
         }
     }
 
+    if (spill_fd >= 0) {
+        close(spill_fd);
+    }
+    if (headers_len == 0) {
+        reply->header_ms = now_ms() - started;
+    }
+    reply->reply_buffer[total_bytes] = '\0';
     reply->reply_buffer_length = total_bytes;
     close(sockfd);
 
     // Check status code
-    int status_code;
+    int status_code = 0;
     sscanf(reply->reply_buffer, "HTTP/1.1 %d", &status_code);
     fprintf(stderr, "Received status code: %d\n", status_code);
 
     if (status_code == 301 || status_code == 302) {
         if (redirect_count >= MAX_DEPTH) {
             fprintf(stderr, "Too many redirects\n");
+            free_http_reply(reply);
             return -1;
         }
 
@@ -499,10 +1244,26 @@ int download_page(url_info *info, http_reply *reply, int redirect_count) {
             if (end_line) {
                 *end_line = '\0';
                 fprintf(stderr, "Redirecting to: %s\n", location);
-                if (update_url(info, location) == 0) {
-                    free(reply->reply_buffer);
-                    return download_page(info, reply, redirect_count + 1);
+                char *hop_url = format_url(info);
+                // parse_url() chops up its argument, and the reply may still be archived
+                char *location_copy = strdup(location);
+                int updated = (update_url(info, location_copy) == 0);
+                free(location_copy);
+                *end_line = '\r';
+                if (updated) {
+                    // Later hops may be other hosts; keep this one's timing
+                    long header_ms = reply->header_ms;
+                    if (warc_enabled()) {
+                        // Each hop gets its own request/response pair
+                        warc_write_exchange(hop_url, reply);
+                    }
+                    free(hop_url);
+                    free_http_reply(reply);
+                    int result = download_page(info, reply, redirect_count + 1);
+                    reply->header_ms = header_ms;
+                    return result;
                 }
+                free(hop_url);
             }
         }
     }
@@ -510,21 +1271,81 @@ int download_page(url_info *info, http_reply *reply, int redirect_count) {
     return 0;
 }
 
-int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s <URL>\n", argv[0]);
-        return 1;
+// Stream the seed list into the queue, one host-sorted batch at a time
+static void *seed_feeder_thread(void *arg) {
+    seed_reader_t *seeds = arg;
+    char **batch = malloc(SEED_BATCH_SIZE * sizeof(char *));
+    int count;
+    
+    while ((count = seed_reader_next_batch(seeds, batch, SEED_BATCH_SIZE)) > 0) {
+        int stopped = 0;
+        for (int i = 0; i < count; i++) {
+            if (!stopped && enqueue_seed_url(batch[i]) != 0) {
+                stopped = 1;
+            }
+            free(batch[i]);
+        }
+        if (stopped) {
+            break;
+        }
     }
+    free(batch);
+    fprintf(stderr, "Seed list done: %ld seeds read\n", seeds->seeds_read);
     
+    pthread_mutex_lock(&url_queue.mutex);
+    url_queue.seeding = 0;
+    if (url_queue.active_threads == 0 && url_queue.size == 0 && host_parked_count() == 0) {
+        // Nothing left to crawl
+        url_queue.should_shutdown = 1;
+        pthread_cond_broadcast(&url_queue.not_empty);
+    }
+    pthread_mutex_unlock(&url_queue.mutex);
+    return NULL;
+}
+
+// WARC output settings from the command line
+static const char *warc_prefix = NULL;
+static size_t warc_max_size = WARC_DEFAULT_MAX_SIZE;
+static int warc_gzip = 0;
+
+// Run the worker pool until the local queue is shut down
+static int run_crawl(const char *seed, seed_reader_t *seeds) {
     // Create downloads directory
     mkdir("downloads", 0755);
     
+    if (warc_prefix) {
+        // Shards each get their own archive series
+        char prefix[1024];
+        if (shard_count > 0) {
+            snprintf(prefix, sizeof(prefix), "%s-shard%d", warc_prefix, shard_id);
+        } else {
+            snprintf(prefix, sizeof(prefix), "%s", warc_prefix);
+        }
+        if (warc_open(prefix, warc_max_size, warc_gzip) != 0) {
+            return 1;
+        }
+    }
+    
     // Initialize queue and thread pool
     init_url_queue();
     
     // Add initial URL
-    fprintf(stderr, "Adding initial URL: %s\n", argv[1]);
-    enqueue_url(argv[1], NULL, 0);
+    if (seed) {
+        fprintf(stderr, "Adding initial URL: %s\n", seed);
+        enqueue_url(seed, NULL, 0);
+    }
+    
+    if (shard_count > 0 && shard_start_receiver() != 0) {
+        cleanup_url_queue();
+        warc_close();
+        return 1;
+    }
+    
+    pthread_t feeder;
+    if (seeds) {
+        url_queue.seeding = 1;
+        pthread_create(&feeder, NULL, seed_feeder_thread, seeds);
+    }
     
     // Create worker threads
     pthread_t threads[THREAD_POOL_SIZE];
@@ -538,10 +1359,198 @@ int main(int argc, char* argv[]) {
         pthread_join(threads[i], NULL);
     }
     
+    if (seeds) {
+        pthread_join(feeder, NULL);
+    }
+    if (shard_count > 0) {
+        shard_stop_receiver();
+    }
+    
     fprintf(stderr, "All threads completed. Cleaning up...\n");
     
     // Cleanup
     cleanup_url_queue();
+    cleanup_visited();
+    hosts_cleanup();
+    warc_close();
+    print_stats();
     
     return 0;
-}
\ No newline at end of file
+}
+
+static int run_shard(void) {
+    return run_crawl(NULL, NULL);
+}
+
+// Parse a byte count with an optional K, M or G suffix
+static size_t parse_size(const char *arg) {
+    char *end;
+    size_t size = strtoull(arg, &end, 10);
+    switch (*end) {
+    case 'G': case 'g': size <<= 30; break;
+    case 'M': case 'm': size <<= 20; break;
+    case 'K': case 'k': size <<= 10; break;
+    }
+    return size;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options] [URL]\n"
+            "  -s, --shards N          crawl with N processes, each owning a hash range of hosts\n"
+            "  -l, --listen PORT       coordinate N remote shards (with --shards) instead of forking\n"
+            "  -j, --join HOST:PORT    run as a shard of a remote coordinator (no URL needed)\n"
+            "  -m, --memory-budget N   cap in-flight crawl data per process, K/M/G suffixes, 0 = unlimited\n"
+            "  -i, --seeds FILE        also crawl every URL listed in FILE, one per line (- for stdin)\n"
+            "      --mmap              memory-map the seed file instead of reading it\n"
+            "  -w, --warc PREFIX       write PREFIX-NNNNN.warc files and PREFIX.cdx instead of downloads/\n"
+            "      --warc-gzip         compress each WARC record as its own gzip member\n"
+            "      --warc-max-size N   start a new WARC file after N bytes, K/M/G suffixes\n"
+            "      --connect-timeout MS     give up connecting after MS milliseconds (default 10000)\n"
+            "      --first-byte-timeout MS  give up when no reply byte arrived after MS (default 30000)\n"
+            "      --idle-timeout MS        give up when a reply stalls for MS (default 30000)\n"
+            "      --slow-response MS       count replies whose headers take over MS against the host (default 20000)\n"
+            "      --host-retry MS          wait MS before probing a host whose circuit opened, doubling each time (default 15000)\n"
+            "      --host-max-retry MS      cap for that wait, and how often a given-up host is re-probed (default 600000)\n"
+            "      --give-up-after N        drop a host's parked URLs once its circuit opened N times in a row (default 3, 0 = never)\n"
+            "      --no-splice         read non-HTML bodies through user space instead of splice()\n",
+            prog);
+}
+
+int main(int argc, char* argv[]) {
+    static const struct option long_options[] = {
+        {"shards", required_argument, NULL, 's'},
+        {"listen", required_argument, NULL, 'l'},
+        {"join",   required_argument, NULL, 'j'},
+        {"memory-budget", required_argument, NULL, 'm'},
+        {"seeds",  required_argument, NULL, 'i'},
+        {"mmap",   no_argument,       NULL, 'M'},
+        {"warc",   required_argument, NULL, 'w'},
+        {"warc-gzip", no_argument,    NULL, 'z'},
+        {"warc-max-size", required_argument, NULL, 'W'},
+        {"connect-timeout", required_argument, NULL, 'C'},
+        {"first-byte-timeout", required_argument, NULL, 'F'},
+        {"idle-timeout", required_argument, NULL, 'I'},
+        {"slow-response", required_argument, NULL, 'S'},
+        {"host-retry", required_argument, NULL, 'R'},
+        {"host-max-retry", required_argument, NULL, 'X'},
+        {"give-up-after", required_argument, NULL, 'G'},
+        {"no-splice", no_argument,    NULL, 'Z'},
+        {NULL, 0, NULL, 0}
+    };
+    int shards = 0;
+    int listen_port = 0;
+    char *join = NULL;
+    const char *seed_path = NULL;
+    int seed_mmap = 0;
+    int opt;
+    
+    while ((opt = getopt_long(argc, argv, "s:l:j:m:i:w:", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 's':
+            shards = atoi(optarg);
+            break;
+        case 'l':
+            listen_port = atoi(optarg);
+            break;
+        case 'j':
+            join = optarg;
+            break;
+        case 'm':
+            budget_init(parse_size(optarg));
+            break;
+        case 'i':
+            seed_path = optarg;
+            break;
+        case 'M':
+            seed_mmap = 1;
+            break;
+        case 'w':
+            warc_prefix = optarg;
+            break;
+        case 'z':
+            warc_gzip = 1;
+            break;
+        case 'W':
+            warc_max_size = parse_size(optarg);
+            break;
+        case 'C':
+            connect_timeout_ms = atoi(optarg);
+            break;
+        case 'F':
+            first_byte_timeout_ms = atoi(optarg);
+            break;
+        case 'I':
+            idle_timeout_ms = atoi(optarg);
+            break;
+        case 'S':
+            slow_response_ms = atoi(optarg);
+            break;
+        case 'R':
+            host_retry_ms = atol(optarg);
+            break;
+        case 'X':
+            host_max_retry_ms = atol(optarg);
+            break;
+        case 'G':
+            host_give_up_openings = atoi(optarg);
+            break;
+        case 'Z':
+            zero_copy_enabled = 0;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    
+    const char *seed = optind < argc ? argv[optind] : NULL;
+    signal(SIGUSR1, request_stats);
+    // A vanished shard or coordinator shows up as EPIPE, not a fatal signal
+    signal(SIGPIPE, SIG_IGN);
+    
+    mode_t mask = umask(0);
+    umask(mask);
+    download_mode = 0666 & ~mask;
+    
+    if (join) {
+        char *colon = strrchr(join, ':');
+        if (colon == NULL) {
+            usage(argv[0]);
+            return 1;
+        }
+        *colon = '\0';
+        if (shard_join_tcp(join, atoi(colon + 1)) != 0) {
+            return 1;
+        }
+        return run_shard();
+    }
+    
+    if ((seed == NULL && seed_path == NULL) || shards < 0 || (listen_port > 0 && shards == 0)) {
+        usage(argv[0]);
+        return 1;
+    }
+    
+    seed_reader_t reader;
+    seed_reader_t *seeds = NULL;
+    if (seed_path) {
+        if (seed_reader_open(&reader, seed_path, seed_mmap) != 0) {
+            return 1;
+        }
+        seeds = &reader;
+    }
+    
+    int result;
+    if (listen_port > 0) {
+        result = coordinator_run_listen(listen_port, shards, seed, seeds) == 0 ? 0 : 1;
+    } else if (shards > 0) {
+        result = coordinator_run_local(shards, seed, seeds, run_shard) == 0 ? 0 : 1;
+    } else {
+        result = run_crawl(seed, seeds);
+    }
+    
+    if (seeds) {
+        seed_reader_close(seeds);
+    }
+    return result;
+}
@@ -1,15 +1,35 @@
 #ifndef WGETX_H_
 #define WGETX_H_
 
+#include <stdio.h>
 #include <pthread.h>
-#include "url.h"
+
+struct url_info;
 
 /* Structure for HTTP reply */
 typedef struct http_reply {
     char *reply_buffer;
     int reply_buffer_length;
+    size_t reply_buffer_size;   // Allocated bytes, charged to the memory budget
+    char *spill_path;           // Body spilled to this file when over budget
+    long spill_length;          // Body bytes in spill_path
+    long zero_copy_bytes;       // Of those, bytes moved by splice()
+    int zero_copy;              // 1 if spliced, -1 if splice() was refused and recv() filled spill_path
+    char *request;              // Request as sent, kept for WARC output
+    long header_ms;             // From connecting to the end of the headers, first hop only
 } http_reply;
 
+/* Crawl counters, printed at exit and on SIGUSR1 */
+typedef struct crawl_stats {
+    long pages_fetched;
+    long pages_failed;
+    long bytes_received;
+    long bodies_spilled;
+    long bodies_zero_copy;
+    long bytes_zero_copy;
+    long splice_fallbacks;
+} crawl_stats_t;
+
 /* Structure for queue items */
 typedef struct queue_item {
     char *url;
@@ -17,6 +37,18 @@ typedef struct queue_item {
     int depth;
 } queue_item_t;
 
+/* Discovered link waiting for room in the queue */
+typedef struct queue_node {
+    struct queue_node *next;
+    queue_item_t item;
+} queue_node_t;
+
+/* Entry of the visited-URL hash set */
+typedef struct visited_node {
+    struct visited_node *next;
+    char url[];
+} visited_node_t;
+
 /* Structure for synchronized queue */
 typedef struct url_queue {
     queue_item_t *items;    // Array of queue items
@@ -24,35 +56,49 @@ typedef struct url_queue {
     int rear;               // Rear of queue
     int size;               // Current size
     int capacity;           // Maximum capacity
-    int active_threads;     // Number of active threads
+    queue_node_t *overflow_head;    // Discovered links beyond capacity, oldest first
+    queue_node_t *overflow_tail;
+    int active_threads;     // Number of threads currently processing an item
     int should_shutdown;    // Shutdown flag
+    long remote_received;   // Links handed over by the shard coordinator
+    int seeding;            // Seed list still being read
     pthread_mutex_t mutex;  // Mutex for thread safety
     pthread_cond_t not_empty;  // Condition for queue not empty
     pthread_cond_t not_full;   // Condition for queue not full
 } url_queue_t;
 
 /* Function declarations for HTTP operations */
-char* http_get_request(url_info *info);
+char* http_get_request(struct url_info *info);
 int find_headers_end(const char *buffer, int length);
 char *read_http_reply(struct http_reply *reply);
-int download_page(url_info *info, http_reply *reply, int redirect_count);
-void write_data(const char *path, const char *data, int len, int is_html);
+int download_page(struct url_info *info, http_reply *reply, int redirect_count);
+void free_http_reply(http_reply *reply);
+void write_data(const char *path, const char *data, size_t len, int is_html);
+void write_spilled_data(const char *path, const char *spill_path, int is_html);
+void print_stats(void);
 
 /* Function declarations for URL handling */
-void free_url_info(url_info *info);
+void free_url_info(struct url_info *info);
 char *next_line(char *buff, int len);
 void create_directories(const char *path);
 int is_visited(const char *url);
+void cleanup_visited(void);
 
 /* Function declarations for queue operations */
 void init_url_queue(void);
 void cleanup_url_queue(void);
 int enqueue_url(const char *url, const char *parent_url, int depth);
+int enqueue_seed_url(const char *url);
 int dequeue_url(queue_item_t *item);
+void finish_url(void);
+void shutdown_url_queue(void);
+void accept_remote_url(const char *url, int depth);
+void report_if_idle(void);
 
 /* Function declarations for HTML processing */
-char* rewrite_html_urls(const char *content, size_t content_len, const char *base_url);
+void write_rewritten_html(FILE *file, const char *content, size_t content_len);
 void extract_urls(const char *html, size_t html_len, const char *base_url, int depth);
+void extract_spilled_urls(const char *spill_path, const char *base_url, int depth);
 
 /* Worker thread function */
 void *worker_thread(void *arg);